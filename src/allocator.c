@@ -0,0 +1,77 @@
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "allocator.h"
+
+static void *malloc_alloc(void *context, size_t size) {
+    (void) context;
+    return malloc(size);
+}
+
+static void *malloc_zero_alloc(void *context, size_t size) {
+    (void) context;
+    return calloc(1, size);
+}
+
+static void malloc_free(void *context, void *pointer, size_t size) {
+    (void) context;
+    (void) size;
+    free(pointer);
+}
+
+const HM172Allocator hm172_malloc_allocator = {malloc_alloc, malloc_zero_alloc, malloc_free, NULL};
+
+#if defined(MAP_ANONYMOUS)
+
+static bool is_huge(size_t size) {
+    return size >= HM172_HUGE_PAGE_SIZE && size <= SIZE_MAX - 2 * HM172_HUGE_PAGE_SIZE;
+}
+
+static size_t round_up_to_huge_page(size_t size) {
+    return (size + HM172_HUGE_PAGE_SIZE - 1) & ~(HM172_HUGE_PAGE_SIZE - 1);
+}
+
+/*
+ * Maps a huge page more than needed and unmaps the unaligned head and tail, as mmap only aligns to the base page size
+ */
+static void *map_huge(size_t size) {
+    size_t mapped_size = round_up_to_huge_page(size);
+    char *mapped = mmap(NULL, mapped_size + HM172_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) return NULL;
+    char *aligned = (char *) round_up_to_huge_page((uintptr_t) mapped);
+    if (aligned != mapped) munmap(mapped, (size_t) (aligned - mapped));
+    munmap(aligned + mapped_size, HM172_HUGE_PAGE_SIZE - (size_t) (aligned - mapped));
+#if defined(MADV_HUGEPAGE)
+    madvise(aligned, mapped_size, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+static void *huge_page_alloc(void *context, size_t size) {
+    (void) context;
+    return is_huge(size) ? map_huge(size) : malloc(size);
+}
+
+/*
+ * Anonymous mappings are already zeroed
+ */
+static void *huge_page_zero_alloc(void *context, size_t size) {
+    (void) context;
+    return is_huge(size) ? map_huge(size) : calloc(1, size);
+}
+
+static void huge_page_free(void *context, void *pointer, size_t size) {
+    (void) context;
+    if (is_huge(size)) munmap(pointer, round_up_to_huge_page(size));
+    else free(pointer);
+}
+
+const HM172Allocator hm172_huge_page_allocator = {huge_page_alloc, huge_page_zero_alloc, huge_page_free, NULL};
+
+#else
+
+const HM172Allocator hm172_huge_page_allocator = {malloc_alloc, malloc_zero_alloc, malloc_free, NULL};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef HASHMAP_172_ALLOCATOR_H
+#define HASHMAP_172_ALLOCATOR_H
+
+#include <stddef.h>
+
+/*
+ * Allocator of the memory a map keeps: the map itself, its tables, entry nodes, key copies, arena slabs and iterators
+ * Temporary buffers that don't outlive a single call are allocated with malloc
+ */
+typedef struct {
+    void *(*alloc)(void *context, size_t size); // returns NULL if memory can't be allocated
+    void *(*zero_alloc)(void *context, size_t size); // alloc returning zeroed memory
+    void (*free)(void *context, void *pointer, size_t size); // size is the one the memory was allocated with, pointer isn't NULL
+    void *context;
+} HM172Allocator;
+
+/*
+ * malloc, calloc and free, used by the maps created without an allocator
+ */
+extern const HM172Allocator hm172_malloc_allocator;
+
+#define HM172_HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+/*
+ * Allocates the blocks of at least HM172_HUGE_PAGE_SIZE bytes, such as the tables of large maps, with anonymous mmap,
+ * aligned to and rounded up to HM172_HUGE_PAGE_SIZE, and marks them with madvise(MADV_HUGEPAGE), so that they are
+ * backed by transparent huge pages and lookups scattered over a large table miss the TLB less often
+ * Smaller blocks are allocated with malloc, as are all of them where anonymous mmap isn't available
+ * Whether huge pages are used is up to the system, see /sys/kernel/mm/transparent_hugepage/enabled on Linux
+ */
+extern const HM172Allocator hm172_huge_page_allocator;
+
+#endif // HASHMAP_172_ALLOCATOR_H
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include "arena.h"
+
+static const size_t MIN_SLAB_SIZE = 16 * 1024;
+static const size_t MAX_SLAB_SIZE = 4 * 1024 * 1024;
+
+typedef union {
+    long long integer;
+    long double real;
+    void *pointer;
+} MaxAlign;
+
+#define ALIGNMENT (sizeof(MaxAlign))
+
+struct slab_t {
+    HM172Slab *next;
+    size_t size; // usable bytes following the header
+    MaxAlign data[]; // aligns the usable bytes
+};
+
+static size_t align_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static HM172Slab *alloc_slab(HM172Arena *arena, size_t slab_size) {
+    HM172Slab *slab = arena->allocator.alloc(arena->allocator.context, sizeof(HM172Slab) + slab_size);
+    if (slab != NULL) slab->size = slab_size;
+    return slab;
+}
+
+static void free_slab(HM172Arena *arena, HM172Slab *slab) {
+    arena->allocator.free(arena->allocator.context, slab, sizeof(HM172Slab) + slab->size);
+}
+
+void hm172_arena_init(HM172Arena *arena, const HM172Allocator *allocator) {
+    arena->allocator = *allocator;
+    arena->slabs = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+    arena->next_slab_size = MIN_SLAB_SIZE;
+}
+
+/*
+ * Allocates a slab that fits at least size bytes
+ * Slabs grow geometrically up to MAX_SLAB_SIZE, so that small maps stay small and large ones do few allocations
+ * Requests that don't fit in a regular slab get a dedicated one, which is linked behind the first slab to keep its free space
+ */
+static char *alloc_in_new_slab(HM172Arena *arena, size_t size) {
+    bool dedicated = size > arena->next_slab_size / 4;
+    size_t slab_size = dedicated ? size : arena->next_slab_size;
+    HM172Slab *slab = alloc_slab(arena, slab_size);
+    if (slab == NULL) return NULL;
+    char *data = (char *) slab->data;
+    if (dedicated && arena->slabs != NULL) {
+        slab->next = arena->slabs->next;
+        arena->slabs->next = slab;
+        return data;
+    }
+    slab->next = arena->slabs;
+    arena->slabs = slab;
+    arena->next = data + size;
+    arena->end = data + slab_size;
+    if (!dedicated && arena->next_slab_size < MAX_SLAB_SIZE) arena->next_slab_size <<= 1u;
+    return data;
+}
+
+void *hm172_arena_alloc(HM172Arena *arena, size_t size, size_t alignment) {
+    if (size > SIZE_MAX - sizeof(HM172Slab) - ALIGNMENT) return NULL;
+    if (arena->next != NULL) {
+        char *allocated = (char *) align_up((uintptr_t) arena->next, alignment);
+        if (allocated <= arena->end && (size_t) (arena->end - allocated) >= size) {
+            arena->next = allocated + size;
+            return allocated;
+        }
+    }
+    return alloc_in_new_slab(arena, size);
+}
+
+bool hm172_arena_reserve(HM172Arena *arena, size_t size) {
+    if (arena->next != NULL && (size_t) (arena->end - arena->next) >= size) return true;
+    if (size > SIZE_MAX - sizeof(HM172Slab)) return false;
+    size_t slab_size = size > arena->next_slab_size ? size : arena->next_slab_size;
+    HM172Slab *slab = alloc_slab(arena, slab_size);
+    if (slab == NULL) return false;
+    slab->next = arena->slabs;
+    arena->slabs = slab;
+    arena->next = (char *) slab->data;
+    arena->end = arena->next + slab_size;
+    return true;
+}
+
+void hm172_arena_reset(HM172Arena *arena) {
+    HM172Slab *first = arena->slabs;
+    if (first == NULL) return;
+    HM172Slab *slab = first->next;
+    while (slab != NULL) {
+        HM172Slab *next = slab->next;
+        free_slab(arena, slab);
+        slab = next;
+    }
+    first->next = NULL;
+    arena->next = (char *) first->data;
+    arena->end = arena->next + first->size;
+}
+
+void hm172_arena_free(HM172Arena *arena) {
+    hm172_arena_reset(arena);
+    if (arena->slabs != NULL) free_slab(arena, arena->slabs);
+    HM172Allocator allocator = arena->allocator;
+    hm172_arena_init(arena, &allocator);
+}
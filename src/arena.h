@@ -0,0 +1,47 @@
+#ifndef HASHMAP_172_ARENA_H
+#define HASHMAP_172_ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "allocator.h"
+
+/*
+ * Bump allocator that carves memory out of large slabs and releases only whole slabs
+ * Individual allocations can't be freed
+ */
+
+typedef struct slab_t HM172Slab;
+
+typedef struct {
+    HM172Slab *slabs; // the most recently allocated slab goes first
+    char *next; // the beginning of the free space of the first slab
+    char *end; // the end of the first slab
+    size_t next_slab_size;
+    HM172Allocator allocator; // of the slabs
+} HM172Arena;
+
+void hm172_arena_init(HM172Arena *arena, const HM172Allocator *allocator);
+
+/*
+ * Returns a pointer to size bytes aligned to the alignment, or NULL if sufficient amount of memory can't be allocated
+ * The alignment must be a power of 2 not greater than the alignment of any basic type
+ */
+void *hm172_arena_alloc(HM172Arena *arena, size_t size, size_t alignment);
+
+/*
+ * Makes the next allocations of size bytes in total, including the alignment padding, succeed
+ * Returns false if sufficient amount of memory can't be allocated
+ */
+bool hm172_arena_reserve(HM172Arena *arena, size_t size);
+
+/*
+ * Makes all the memory allocated from the arena invalid, keeps the most recently allocated slab for further allocations
+ */
+void hm172_arena_reset(HM172Arena *arena);
+
+/*
+ * Releases all the slabs
+ */
+void hm172_arena_free(HM172Arena *arena);
+
+#endif // HASHMAP_172_ARENA_H
@@ -0,0 +1,703 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "../status.h"
+#include "../map.h"
+#include "../hash_functions.h"
+
+#define MAX_LIST_LENGTH 16
+#define ALPHABET_SIZE 26
+#define TIMER_CALIBRATION_COUNT 1001
+
+static const char *CSV_OPTION = "--csv";
+static const char *ENGINES_OPTION = "--engines";
+static const char *HASHES_OPTION = "--hashes";
+static const char *DISTRIBUTIONS_OPTION = "--distributions";
+static const char *WORKLOADS_OPTION = "--workloads";
+static const char *SIZES_OPTION = "--sizes";
+static const char *KEY_LENGTHS_OPTION = "--key-lengths";
+static const char *CAPACITIES_OPTION = "--capacities";
+static const char *LOAD_FACTORS_OPTION = "--load-factors";
+static const char *OP_COUNT_OPTION = "--ops";
+static const char *SEED_OPTION = "--seed";
+
+static const size_t DEFAULT_OP_COUNT = 1u << 20u;
+static const uint64_t DEFAULT_SEED = 172;
+static const double ZIPF_EXPONENT = 0.99;
+static const int BULK_PASS_COUNT = 5;
+
+/*
+ * Adversarial keys all have the same hash under hm172_polynomial_hash, so every operation scans all of them,
+ * which is quadratic for the whole workload
+ */
+static const size_t ADVERSARIAL_MAX_SIZE = 1024;
+static const size_t ADVERSARIAL_MAX_OP_COUNT = 16384;
+
+typedef enum {
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_ZIPF,
+    DISTRIBUTION_ADVERSARIAL,
+    DISTRIBUTION_COUNT
+} Distribution;
+
+typedef enum {
+    WORKLOAD_PUT,
+    WORKLOAD_GET,
+    WORKLOAD_UPDATE,
+    WORKLOAD_ITERATE,
+    WORKLOAD_CLEAR,
+    WORKLOAD_MERGE,
+    WORKLOAD_RESERVE,
+    WORKLOAD_COUNT
+} Workload;
+
+static const char *const ENGINE_NAMES[] = {"chained", "open-addressing", "dense"}; // indexed by HM172Engine
+static const char *const HASH_NAMES[] = {"polynomial", "mum", "stripe"};
+static const hash_n_function_t HASH_N_FUNCTIONS[] = {NULL, hm172_mum_hash, hm172_stripe_hash};
+static const char *const DISTRIBUTION_NAMES[] = {"uniform", "zipf", "adversarial"};
+static const char *const WORKLOAD_NAMES[] = {"put", "get", "update", "iterate", "clear", "merge", "reserve"};
+
+typedef struct {
+    size_t count;
+    size_t values[MAX_LIST_LENGTH];
+} SizeList;
+
+typedef struct {
+    size_t count;
+    float values[MAX_LIST_LENGTH];
+} FloatList;
+
+typedef struct {
+    SizeList engines; // indices of ENGINE_NAMES
+    SizeList hashes; // indices of HASH_NAMES
+    SizeList distributions;
+    SizeList workloads;
+    SizeList sizes;
+    SizeList key_lengths;
+    SizeList capacities;
+    FloatList load_factors;
+    size_t op_count;
+    uint64_t seed;
+    FILE *csv_file; // NULL if CSV output isn't requested
+} BenchOptions;
+
+typedef struct {
+    HM172MapOptions map_options;
+    Distribution distribution;
+    size_t hash_index;
+    size_t size;
+} BenchConfig;
+
+/*
+ * size distinct keys and the sequence of key indices that get and update workloads look up
+ */
+typedef struct {
+    char *key_data;
+    char **keys;
+    size_t key_length;
+    size_t *op_indices;
+    size_t op_count;
+} KeySet;
+
+typedef struct {
+    double ns_per_op;
+    double p50, p90, p99, p999;
+} BenchResult;
+
+static uint64_t timer_overhead_ns;
+
+/*
+ * Read values are stored here, so that the reads aren't optimized out
+ */
+volatile HM172Value sink;
+
+int str_to_size_t(char *str, size_t *result, const char *variable_name) {
+    char *endptr;
+    uintmax_t result_umax = strtoumax(str, &endptr, 0);
+    if (endptr == str || *endptr != '\0') {
+        LOG_ERROR("Invalid %s. \"%s\" is not a valid number of size_t type\n", variable_name, str);
+        return -1;
+    }
+    if (result_umax == UINTMAX_MAX || result_umax > SIZE_MAX) {
+        LOG_ERROR("Invalid %s. %s is too large\n", variable_name, str);
+        return -1;
+    }
+    *result = result_umax;
+    return 0;
+}
+
+int str_to_float(char *str, float *result, const char *variable_name) {
+    char *endptr;
+    *result = strtof(str, &endptr);
+    if (endptr == str || *endptr != '\0') {
+        LOG_ERROR("Invalid %s. \"%s\" is not a valid number of float type\n", variable_name, str);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Parses comma separated numbers, the str is modified
+ */
+int parse_size_list(char *str, SizeList *list, const char *variable_name) {
+    list->count = 0;
+    for (char *item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (list->count == MAX_LIST_LENGTH) {
+            LOG_ERROR("Invalid %s. At most %d values are allowed\n", variable_name, MAX_LIST_LENGTH);
+            return -1;
+        }
+        if (str_to_size_t(item, &list->values[list->count++], variable_name) != 0) return -1;
+    }
+    return 0;
+}
+
+int parse_float_list(char *str, FloatList *list, const char *variable_name) {
+    list->count = 0;
+    for (char *item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (list->count == MAX_LIST_LENGTH) {
+            LOG_ERROR("Invalid %s. At most %d values are allowed\n", variable_name, MAX_LIST_LENGTH);
+            return -1;
+        }
+        if (str_to_float(item, &list->values[list->count++], variable_name) != 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ * Parses comma separated names into their indices in the names array, the str is modified
+ */
+int parse_name_list(char *str, const char *const names[], size_t name_count, SizeList *list,
+                    const char *variable_name) {
+    list->count = 0;
+    for (char *item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        size_t index = 0;
+        while (index < name_count && strcmp(item, names[index]) != 0) index++;
+        if (index == name_count) {
+            LOG_ERROR("Invalid %s. Unknown name \"%s\"\n", variable_name, item);
+            return -1;
+        }
+        if (list->count == MAX_LIST_LENGTH) {
+            LOG_ERROR("Invalid %s. At most %d values are allowed\n", variable_name, MAX_LIST_LENGTH);
+            return -1;
+        }
+        list->values[list->count++] = index;
+    }
+    return 0;
+}
+
+void set_all_indices(SizeList *list, size_t count) {
+    list->count = count;
+    for (size_t i = 0; i < count; i++) list->values[i] = i;
+}
+
+uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30u)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27u)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31u);
+}
+
+/*
+ * Returns a uniformly distributed number in [0, 1)
+ */
+double next_random_double(uint64_t *state) {
+    return (double) (next_random(state) >> 11u) * 0x1.0p-53;
+}
+
+uint64_t get_time_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+int compare_uint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Measures the median cost of reading the timer, which is subtracted from the latencies of single operations
+ */
+void calibrate_timer(void) {
+    uint64_t samples[TIMER_CALIBRATION_COUNT];
+    for (int i = 0; i < TIMER_CALIBRATION_COUNT; i++) {
+        uint64_t start = get_time_ns();
+        samples[i] = get_time_ns() - start;
+    }
+    qsort(samples, TIMER_CALIBRATION_COUNT, sizeof(uint64_t), compare_uint64);
+    timer_overhead_ns = samples[TIMER_CALIBRATION_COUNT / 2];
+}
+
+/*
+ * Returns the number of bytes allocated with malloc, or 0 if the C library can't tell
+ */
+size_t get_heap_bytes(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Uniform and Zipf keys are random lowercase strings ending with the key index in base 26, so they are distinct
+ * Adversarial keys are 'x' padded concatenations of "Aa" and "BB" blocks selected by the bits of the key index,
+ * which all have the same polynomial hash
+ */
+int generate_keys(KeySet *key_set, Distribution distribution, size_t size, size_t key_length, uint64_t *random) {
+    size_t digit_count = 1;
+    if (distribution == DISTRIBUTION_ADVERSARIAL) {
+        while (((size_t) 1 << digit_count) < size) digit_count++;
+        if (key_length < 2 * digit_count) key_length = 2 * digit_count;
+    } else {
+        for (size_t max_index = size - 1; max_index >= ALPHABET_SIZE; max_index /= ALPHABET_SIZE) digit_count++;
+        if (key_length < digit_count) {
+            LOG_ERROR("Key length %zu is too short for %zu distinct keys\n", key_length, size);
+            return -1;
+        }
+    }
+    key_set->key_length = key_length;
+    key_set->key_data = malloc(size * (key_length + 1));
+    key_set->keys = malloc(size * sizeof(char *));
+    if (key_set->key_data == NULL || key_set->keys == NULL) {
+        LOG_ERROR("Unable to allocate memory for %zu keys\n", size);
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        char *key = key_set->key_data + i * (key_length + 1);
+        key_set->keys[i] = key;
+        key[key_length] = '\0';
+        if (distribution == DISTRIBUTION_ADVERSARIAL) {
+            size_t padding_length = key_length - 2 * digit_count;
+            memset(key, 'x', padding_length);
+            for (size_t bit = 0; bit < digit_count; bit++)
+                memcpy(key + padding_length + 2 * bit, (i >> bit) & 1u ? "BB" : "Aa", 2);
+            continue;
+        }
+        for (size_t j = 0; j < key_length - digit_count; j++)
+            key[j] = (char) ('a' + next_random(random) % ALPHABET_SIZE);
+        size_t index = i;
+        for (size_t j = key_length; j > key_length - digit_count; j--, index /= ALPHABET_SIZE)
+            key[j - 1] = (char) ('a' + index % ALPHABET_SIZE);
+    }
+    return 0;
+}
+
+/*
+ * Zipf distribution makes key i the (i + 1)th most frequent one, the keys themselves are random
+ */
+int generate_op_indices(KeySet *key_set, Distribution distribution, size_t size, size_t op_count, uint64_t *random) {
+    key_set->op_count = op_count;
+    key_set->op_indices = malloc(op_count * sizeof(size_t));
+    if (key_set->op_indices == NULL) {
+        LOG_ERROR("Unable to allocate memory for %zu operations\n", op_count);
+        return -1;
+    }
+    if (distribution != DISTRIBUTION_ZIPF) {
+        for (size_t i = 0; i < op_count; i++)
+            key_set->op_indices[i] = next_random(random) % size;
+        return 0;
+    }
+    double *cumulative_weights = malloc(size * sizeof(double));
+    if (cumulative_weights == NULL) {
+        LOG_ERROR("Unable to allocate memory for Zipf distribution of %zu keys\n", size);
+        return -1;
+    }
+    double total_weight = 0;
+    for (size_t i = 0; i < size; i++)
+        cumulative_weights[i] = total_weight += 1 / pow((double) (i + 1), ZIPF_EXPONENT);
+    for (size_t i = 0; i < op_count; i++) {
+        double target = next_random_double(random) * total_weight;
+        size_t low = 0, high = size - 1;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (cumulative_weights[middle] <= target) low = middle + 1;
+            else high = middle;
+        }
+        key_set->op_indices[i] = low;
+    }
+    free(cumulative_weights);
+    return 0;
+}
+
+void free_key_set(KeySet *key_set) {
+    free(key_set->key_data);
+    free(key_set->keys);
+    free(key_set->op_indices);
+}
+
+HM172Value increment(HM172Value value, void *context) {
+    (void) context;
+    return value + 1;
+}
+
+/*
+ * Performs the ith operation of a put, get or update workload
+ */
+void do_operation(Workload workload, HM172Map *map, KeySet *key_set, size_t i) {
+    switch (workload) {
+        case WORKLOAD_PUT:
+            hm172_put(map, key_set->keys[i], (HM172Value) i);
+            break;
+        case WORKLOAD_GET: {
+            HM172Value *value = hm172_get(map, key_set->keys[key_set->op_indices[i]]);
+            if (value != NULL) sink = *value;
+            break;
+        }
+        default:
+            hm172_update(map, key_set->keys[key_set->op_indices[i]], 0, increment, NULL);
+    }
+}
+
+/*
+ * Sorts the samples and sets the percentiles of the result
+ */
+void set_percentiles(BenchResult *result, uint64_t *samples, size_t sample_count) {
+    qsort(samples, sample_count, sizeof(uint64_t), compare_uint64);
+    result->p50 = (double) samples[(size_t) (0.5 * (double) (sample_count - 1))];
+    result->p90 = (double) samples[(size_t) (0.9 * (double) (sample_count - 1))];
+    result->p99 = (double) samples[(size_t) (0.99 * (double) (sample_count - 1))];
+    result->p999 = (double) samples[(size_t) (0.999 * (double) (sample_count - 1))];
+}
+
+int fill_map(HM172Map *map, KeySet *key_set, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        do_operation(WORKLOAD_PUT, map, key_set, i);
+    return hm172_log_on_error(map) ? -1 : 0;
+}
+
+/*
+ * Runs the operations twice: without per operation timing for the mean, which isn't skewed by the timer,
+ * and with it for the percentiles
+ * Puts go to a new map each time, gets and updates to the filled map
+ */
+int run_point_workload(Workload workload, const BenchConfig *config, HM172Map *filled_map, KeySet *key_set,
+                       uint64_t *samples, BenchResult *result) {
+    size_t op_count = workload == WORKLOAD_PUT ? config->size : key_set->op_count;
+    for (int pass = 0; pass < 2; pass++) {
+        HM172Map *map = filled_map;
+        if (workload == WORKLOAD_PUT && (map = hm172_new_map_with_options(&config->map_options)) == NULL) {
+            LOG_ERROR("Unable to allocate memory for map\n");
+            return -1;
+        }
+        uint64_t start = get_time_ns();
+        if (pass == 0) {
+            for (size_t i = 0; i < op_count; i++)
+                do_operation(workload, map, key_set, i);
+            result->ns_per_op = (double) (get_time_ns() - start) / (double) op_count;
+        } else {
+            for (size_t i = 0; i < op_count; i++) {
+                uint64_t op_start = get_time_ns();
+                do_operation(workload, map, key_set, i);
+                uint64_t op_time = get_time_ns() - op_start;
+                samples[i] = op_time > timer_overhead_ns ? op_time - timer_overhead_ns : 0;
+            }
+        }
+        bool failed = hm172_log_on_error(map);
+        if (map != filled_map) hm172_free(map);
+        if (failed) return -1;
+    }
+    set_percentiles(result, samples, op_count);
+    return 0;
+}
+
+/*
+ * Iteration and clearing are timed as a whole, the percentiles are those of the per entry times of the passes
+ * The filled map stays filled
+ */
+int run_bulk_workload(Workload workload, HM172Map *filled_map, KeySet *key_set, size_t size,
+                      uint64_t *samples, BenchResult *result) {
+    uint64_t total_time = 0;
+    for (int pass = 0; pass < BULK_PASS_COUNT; pass++) {
+        uint64_t start = get_time_ns();
+        if (workload == WORKLOAD_ITERATE) {
+            HM172EntryIterator *iterator = hm172_get_entry_iterator(filled_map);
+            if (hm172_log_on_error(filled_map)) return -1;
+            HM172Entry *entry;
+            while ((entry = hm172_next_entry(iterator)) != NULL) sink = hm172_get_entry_value(entry);
+            hm172_free_entry_iterator(iterator);
+        } else hm172_clear(filled_map);
+        uint64_t time = get_time_ns() - start;
+        total_time += time;
+        samples[pass] = time / size;
+        if (workload == WORKLOAD_CLEAR && fill_map(filled_map, key_set, size) != 0) return -1;
+    }
+    result->ns_per_op = (double) total_time / BULK_PASS_COUNT / (double) size;
+    set_percentiles(result, samples, BULK_PASS_COUNT);
+    return 0;
+}
+
+/*
+ * Returns 0 if the map holds exactly the first size keys of the key set, so that the workloads resizing the map
+ * to a multiple of its capacity at once fail if they lose entries
+ */
+int check_map(HM172Map *map, KeySet *key_set, size_t size, Workload workload) {
+    bool holds_keys = hm172_size(map) == size;
+    for (size_t i = 0; holds_keys && i < size; i++) holds_keys = hm172_get(map, key_set->keys[i]) != NULL;
+    if (holds_keys) return 0;
+    LOG_ERROR("The map doesn't hold the keys put to it after %s workload\n", WORKLOAD_NAMES[workload]);
+    return -1;
+}
+
+/*
+ * Starts from a new map holding the first eighth of the keys, which is resized at once to fit all of them:
+ * merging merges the filled map into it, and reserving reserves the size and puts the rest of the keys
+ * The percentiles are those of the per entry times of the passes
+ */
+int run_resizing_workload(Workload workload, const BenchConfig *config, HM172Map *filled_map, KeySet *key_set,
+                          uint64_t *samples, BenchResult *result) {
+    uint64_t total_time = 0;
+    for (int pass = 0; pass < BULK_PASS_COUNT; pass++) {
+        HM172Map *map = hm172_new_map_with_options(&config->map_options);
+        if (map == NULL) {
+            LOG_ERROR("Unable to allocate memory for map\n");
+            return -1;
+        }
+        int result_code = fill_map(map, key_set, config->size / 8);
+        uint64_t start = get_time_ns();
+        if (result_code == 0 && workload == WORKLOAD_MERGE) hm172_merge(map, filled_map, NULL);
+        else if (result_code == 0) {
+            hm172_reserve(map, config->size);
+            for (size_t i = config->size / 8; i < config->size; i++) do_operation(WORKLOAD_PUT, map, key_set, i);
+        }
+        uint64_t time = get_time_ns() - start;
+        if (result_code == 0 && (hm172_log_on_error(map) || check_map(map, key_set, config->size, workload) != 0))
+            result_code = -1;
+        hm172_free(map);
+        if (result_code != 0) return -1;
+        total_time += time;
+        samples[pass] = time / config->size;
+    }
+    result->ns_per_op = (double) total_time / BULK_PASS_COUNT / (double) config->size;
+    set_percentiles(result, samples, BULK_PASS_COUNT);
+    return 0;
+}
+
+int print_result(const BenchOptions *options, const BenchConfig *config, size_t key_length, Workload workload,
+                 const BenchResult *result, double bytes_per_entry) {
+    const char *engine_name = ENGINE_NAMES[config->map_options.engine];
+    const char *hash_name = HASH_NAMES[config->hash_index];
+    const char *distribution_name = DISTRIBUTION_NAMES[config->distribution];
+    if (printf("%-15s %-10s %-11s %5zu %8zu %8zu %5.3f %-7s %9.1f %8.0f %8.0f %8.0f %8.0f %8.1f\n",
+               engine_name, hash_name, distribution_name, key_length, config->size, config->map_options.capacity,
+               config->map_options.load_factor, WORKLOAD_NAMES[workload], result->ns_per_op,
+               result->p50, result->p90, result->p99, result->p999, bytes_per_entry) < 0) {
+        LOG_ERROR("Unable to print results\n");
+        return -1;
+    }
+    if (options->csv_file != NULL
+        && fprintf(options->csv_file, "%s,%s,%s,%zu,%zu,%zu,%g,%s,%.2f,%.0f,%.0f,%.0f,%.0f,%.2f\n",
+                   engine_name, hash_name, distribution_name, key_length, config->size, config->map_options.capacity,
+                   config->map_options.load_factor, WORKLOAD_NAMES[workload], result->ns_per_op,
+                   result->p50, result->p90, result->p99, result->p999, bytes_per_entry) < 0) {
+        LOG_ERROR("Unable to print results to CSV file\n");
+        return -1;
+    }
+    return 0;
+}
+
+int print_header(const BenchOptions *options) {
+    if (printf("%-15s %-10s %-11s %5s %8s %8s %5s %-7s %9s %8s %8s %8s %8s %8s\n",
+               "engine", "hash", "keys", "len", "size", "capacity", "lf", "op", "ns/op",
+               "p50", "p90", "p99", "p99.9", "B/entry") < 0) {
+        LOG_ERROR("Unable to print results\n");
+        return -1;
+    }
+    if (options->csv_file != NULL
+        && fputs("engine,hash,distribution,key_length,size,capacity,load_factor,workload,ns_per_op,"
+                 "p50_ns,p90_ns,p99_ns,p999_ns,bytes_per_entry\n", options->csv_file) < 0) {
+        LOG_ERROR("Unable to print results to CSV file\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Runs the selected workloads for one configuration
+ * Bytes per entry are the heap bytes allocated by filling an empty map, including the key copies
+ */
+int run_config(const BenchOptions *options, const BenchConfig *config, size_t key_length, uint64_t *random) {
+    KeySet key_set = {NULL, NULL, 0, NULL, 0};
+    size_t op_count = options->op_count;
+    if (config->distribution == DISTRIBUTION_ADVERSARIAL && op_count > ADVERSARIAL_MAX_OP_COUNT)
+        op_count = ADVERSARIAL_MAX_OP_COUNT;
+    size_t sample_count = op_count > config->size ? op_count : config->size;
+    if (sample_count < (size_t) BULK_PASS_COUNT) sample_count = BULK_PASS_COUNT;
+    uint64_t *samples = malloc(sample_count * sizeof(uint64_t));
+    HM172Map *map = NULL;
+    int result_code = -1;
+    if (samples == NULL) {
+        LOG_ERROR("Unable to allocate memory for %zu latency samples\n", sample_count);
+        goto cleanup;
+    }
+    if (generate_keys(&key_set, config->distribution, config->size, key_length, random) != 0
+        || generate_op_indices(&key_set, config->distribution, config->size, op_count, random) != 0)
+        goto cleanup;
+    size_t heap_bytes_before = get_heap_bytes();
+    map = hm172_new_map_with_options(&config->map_options);
+    if (map == NULL) {
+        LOG_ERROR("Unable to allocate memory for map\n");
+        goto cleanup;
+    }
+    if (fill_map(map, &key_set, config->size) != 0) goto cleanup;
+    double bytes_per_entry = (double) (get_heap_bytes() - heap_bytes_before) / (double) config->size;
+    for (size_t i = 0; i < options->workloads.count; i++) {
+        Workload workload = (Workload) options->workloads.values[i];
+        BenchResult result;
+        int workload_result = workload == WORKLOAD_MERGE || workload == WORKLOAD_RESERVE
+                              ? run_resizing_workload(workload, config, map, &key_set, samples, &result)
+                              : workload == WORKLOAD_ITERATE || workload == WORKLOAD_CLEAR
+                              ? run_bulk_workload(workload, map, &key_set, config->size, samples, &result)
+                              : run_point_workload(workload, config, map, &key_set, samples, &result);
+        if (workload_result != 0
+            || print_result(options, config, key_set.key_length, workload, &result, bytes_per_entry) != 0)
+            goto cleanup;
+    }
+    result_code = 0;
+    cleanup:
+    hm172_free(map);
+    free_key_set(&key_set);
+    free(samples);
+    return result_code;
+}
+
+int run_benchmarks(const BenchOptions *options) {
+    if (print_header(options) != 0) return -1;
+    uint64_t random = options->seed;
+    for (size_t engine = 0; engine < options->engines.count; engine++)
+    for (size_t hash = 0; hash < options->hashes.count; hash++)
+    for (size_t distribution = 0; distribution < options->distributions.count; distribution++)
+    for (size_t size = 0; size < options->sizes.count; size++)
+    for (size_t key_length = 0; key_length < options->key_lengths.count; key_length++)
+    for (size_t capacity = 0; capacity < options->capacities.count; capacity++)
+    for (size_t load_factor = 0; load_factor < options->load_factors.count; load_factor++) {
+        size_t hash_index = options->hashes.values[hash];
+        BenchConfig config = {
+                .map_options = {
+                        .engine = (HM172Engine) options->engines.values[engine],
+                        .capacity = options->capacities.values[capacity],
+                        .load_factor = options->load_factors.values[load_factor],
+                        .hash_function = hm172_polynomial_hash,
+                        .hash_n_function = HASH_N_FUNCTIONS[hash_index]
+                },
+                .distribution = (Distribution) options->distributions.values[distribution],
+                .hash_index = hash_index,
+                .size = options->sizes.values[size]
+        };
+        if (config.distribution == DISTRIBUTION_ADVERSARIAL && config.size > ADVERSARIAL_MAX_SIZE)
+            config.size = ADVERSARIAL_MAX_SIZE;
+        if (run_config(options, &config, options->key_lengths.values[key_length], &random) != 0) return -1;
+        fflush(stdout);
+    }
+    return 0;
+}
+
+void print_usage(void) {
+    LOG_ERROR("Usage: hm172_bench [options], where options with their defaults are:\n"
+              "  %s chained,open-addressing,dense\n"
+              "  %s polynomial (also: mum, stripe)\n"
+              "  %s uniform,zipf,adversarial\n"
+              "  %s put,get,update,iterate,clear,merge,reserve\n"
+              "  %s 1000,100000 (number of distinct keys, adversarial ones are capped at %zu)\n"
+              "  %s 8,32\n"
+              "  %s 0 (initial capacities)\n"
+              "  %s 0.75\n"
+              "  %s %zu (get and update operations, adversarial ones are capped at %zu)\n"
+              "  %s %" PRIu64 "\n"
+              "  %s <CSV output file>\n",
+              ENGINES_OPTION, HASHES_OPTION, DISTRIBUTIONS_OPTION, WORKLOADS_OPTION, SIZES_OPTION, ADVERSARIAL_MAX_SIZE,
+              KEY_LENGTHS_OPTION, CAPACITIES_OPTION, LOAD_FACTORS_OPTION, OP_COUNT_OPTION, DEFAULT_OP_COUNT,
+              ADVERSARIAL_MAX_OP_COUNT, SEED_OPTION, DEFAULT_SEED, CSV_OPTION);
+}
+
+int parse_option(char *name, char *value, BenchOptions *options) {
+    if (strcmp(name, ENGINES_OPTION) == 0)
+        return parse_name_list(value, ENGINE_NAMES, sizeof(ENGINE_NAMES) / sizeof(*ENGINE_NAMES),
+                               &options->engines, "engines");
+    if (strcmp(name, HASHES_OPTION) == 0)
+        return parse_name_list(value, HASH_NAMES, sizeof(HASH_NAMES) / sizeof(*HASH_NAMES), &options->hashes, "hashes");
+    if (strcmp(name, DISTRIBUTIONS_OPTION) == 0)
+        return parse_name_list(value, DISTRIBUTION_NAMES, DISTRIBUTION_COUNT, &options->distributions, "distributions");
+    if (strcmp(name, WORKLOADS_OPTION) == 0)
+        return parse_name_list(value, WORKLOAD_NAMES, WORKLOAD_COUNT, &options->workloads, "workloads");
+    if (strcmp(name, SIZES_OPTION) == 0) return parse_size_list(value, &options->sizes, "sizes");
+    if (strcmp(name, KEY_LENGTHS_OPTION) == 0) return parse_size_list(value, &options->key_lengths, "key lengths");
+    if (strcmp(name, CAPACITIES_OPTION) == 0) return parse_size_list(value, &options->capacities, "capacities");
+    if (strcmp(name, LOAD_FACTORS_OPTION) == 0) return parse_float_list(value, &options->load_factors, "load factors");
+    if (strcmp(name, OP_COUNT_OPTION) == 0) return str_to_size_t(value, &options->op_count, "operation count");
+    if (strcmp(name, SEED_OPTION) == 0) {
+        size_t seed;
+        if (str_to_size_t(value, &seed, "seed") != 0) return -1;
+        options->seed = seed;
+        return 0;
+    }
+    if (strcmp(name, CSV_OPTION) == 0) {
+        if (options->csv_file != NULL) fclose(options->csv_file);
+        options->csv_file = fopen(value, "w");
+        if (options->csv_file == NULL) {
+            LOG_ERROR("Unable to open CSV file \"%s\"\n", value);
+            return -1;
+        }
+        return 0;
+    }
+    LOG_ERROR("Unknown option \"%s\"\n", name);
+    print_usage();
+    return -1;
+}
+
+int validate_options(const BenchOptions *options) {
+    for (size_t i = 0; i < options->sizes.count; i++)
+        if (options->sizes.values[i] == 0) {
+            LOG_ERROR("Invalid sizes. They must be positive\n");
+            return -1;
+        }
+    if (options->op_count == 0) {
+        LOG_ERROR("Invalid operation count. It must be positive\n");
+        return -1;
+    }
+    if (options->engines.count == 0 || options->hashes.count == 0 || options->distributions.count == 0
+        || options->workloads.count == 0 || options->sizes.count == 0 || options->key_lengths.count == 0
+        || options->capacities.count == 0 || options->load_factors.count == 0) {
+        LOG_ERROR("Invalid options. Lists must not be empty\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options = {
+            .sizes = {2, {1000, 100000}},
+            .key_lengths = {2, {8, 32}},
+            .capacities = {1, {0}},
+            .load_factors = {1, {0.75f}},
+            .op_count = DEFAULT_OP_COUNT,
+            .seed = DEFAULT_SEED,
+            .csv_file = NULL
+    };
+    set_all_indices(&options.engines, sizeof(ENGINE_NAMES) / sizeof(*ENGINE_NAMES));
+    set_all_indices(&options.hashes, 1);
+    set_all_indices(&options.distributions, DISTRIBUTION_COUNT);
+    set_all_indices(&options.workloads, WORKLOAD_COUNT);
+    if (argc % 2 == 0) {
+        LOG_ERROR("Invalid number of command line arguments. Every option must have a value\n");
+        print_usage();
+        return -1;
+    }
+    for (int i = 1; i < argc; i += 2)
+        if (parse_option(argv[i], argv[i + 1], &options) != 0) {
+            if (options.csv_file != NULL) fclose(options.csv_file);
+            return -1;
+        }
+    calibrate_timer();
+    int result = validate_options(&options) == 0 ? run_benchmarks(&options) : -1;
+    if (options.csv_file != NULL && fclose(options.csv_file) != 0) {
+        LOG_ERROR("Unable to close CSV file\n");
+        return -1;
+    }
+    return result;
+}
@@ -0,0 +1,517 @@
+#include <memory.h>
+#include "map_engine.h"
+#include "hash_functions.h"
+
+/*
+ * Separate chaining: the table is an array of singly linked node lists
+ * A chain that gets longer than INDEX_THRESHOLD nodes, e.g. because the keys collide on purpose, is indexed
+ * by a hash table of its nodes keyed by a secondary hash with a random seed, so that its lookups don't walk it
+ * An indexed bucket points to the index, tagged with the lowest bit, and the index holds the chain head
+ * The chain still links all the nodes, so the index is only a shortcut: it is dropped when the chain is relinked
+ * by a migration, which indexes the relinked chain again if it's still long, or when the index can't be grown,
+ * and then rebuilt by the next insertion walking the long chain
+ */
+
+#define INDEX_THRESHOLD 16
+
+typedef struct node_t Node;
+
+struct node_t {
+    HM172Entry entry; // must be the first member, so that entry pointer can be cast to node pointer
+    Node *next;
+};
+
+typedef struct {
+    Node *node; // NULL if the slot is empty
+    Node *previous; // the node linking to this one in the chain, NULL for the head
+    uint64_t hash; // secondary hash of the node key
+} IndexSlot;
+
+typedef struct {
+    Node *head;
+    uint64_t seed;
+    size_t size;
+    size_t capacity; // power of 2, at least twice the size, slots are probed linearly
+    IndexSlot slots[];
+} ChainIndex;
+
+static Node **get_table(HM172Map *map) {
+    return (Node **) map->table;
+}
+
+static bool is_indexed(Node *bucket) {
+    return (uintptr_t) bucket & 1u;
+}
+
+static ChainIndex *get_index(Node *bucket) {
+    return (ChainIndex *) ((uintptr_t) bucket & ~(uintptr_t) 1u);
+}
+
+/*
+ * Returns the link to the first node of the bucket chain
+ */
+static Node **get_chain(Node **bucket) {
+    return is_indexed(*bucket) ? &get_index(*bucket)->head : bucket;
+}
+
+static size_t get_index_size(size_t capacity) {
+    return sizeof(ChainIndex) + capacity * sizeof(IndexSlot);
+}
+
+/*
+ * Frees the index of the bucket if there is one, leaving the plain chain
+ */
+static void drop_index(HM172Map *map, Node **bucket) {
+    if (!is_indexed(*bucket)) return;
+    ChainIndex *index = get_index(*bucket);
+    *bucket = index->head;
+    hm172_deallocate(map, index, get_index_size(index->capacity));
+}
+
+static uint64_t hash_secondary(const ChainIndex *index, HM172ConstKey key, size_t key_length) {
+    return hm172_mum_hash(key, key_length, index->seed);
+}
+
+/*
+ * Returns the slot of the node with the key, or the empty slot where it would be added
+ * Adds the number of compared nodes to *probe_count
+ */
+static IndexSlot *find_slot(ChainIndex *index, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                            uint64_t secondary_hash, size_t *probe_count) {
+    size_t mask = index->capacity - 1;
+    for (size_t i = secondary_hash & mask;; i = (i + 1) & mask) {
+        IndexSlot *slot = index->slots + i;
+        if (slot->node == NULL) return slot;
+        (*probe_count)++;
+        if (slot->hash == secondary_hash && slot->node->entry.hash == hash
+            && hm172_entry_has_key(&slot->node->entry, key, key_length))
+            return slot;
+    }
+}
+
+static IndexSlot *find_node_slot(ChainIndex *index, Node *node) {
+    size_t mask = index->capacity - 1;
+    size_t i = hash_secondary(index, hm172_entry_key(&node->entry), node->entry.key_length) & mask;
+    while (index->slots[i].node != node) i = (i + 1) & mask;
+    return index->slots + i;
+}
+
+static void add_slot(ChainIndex *index, Node *node, Node *previous, uint64_t secondary_hash) {
+    size_t mask = index->capacity - 1;
+    size_t i = secondary_hash & mask;
+    while (index->slots[i].node != NULL) i = (i + 1) & mask;
+    index->slots[i] = (IndexSlot) {node, previous, secondary_hash};
+    index->size++;
+}
+
+/*
+ * Backward shift deletion: the following slots of the probe run are moved to the hole if their probes pass it
+ */
+static void erase_slot(ChainIndex *index, IndexSlot *slot) {
+    size_t mask = index->capacity - 1;
+    size_t hole = (size_t) (slot - index->slots);
+    for (size_t i = (hole + 1) & mask; index->slots[i].node != NULL; i = (i + 1) & mask) {
+        size_t home = index->slots[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->slots[hole] = index->slots[i];
+            hole = i;
+        }
+    }
+    index->slots[hole].node = NULL;
+    index->size--;
+}
+
+static ChainIndex *new_index(HM172Map *map, size_t capacity, uint64_t seed) {
+    ChainIndex *index = hm172_allocate_zeroed(map, get_index_size(capacity));
+    if (index == NULL) return NULL;
+    index->seed = seed;
+    index->capacity = capacity;
+    return index;
+}
+
+/*
+ * Indexes the plain chain of the bucket, which is left as is if memory can't be allocated
+ * The random seed is drawn by the first index of the map and shared by all the later ones
+ */
+static void build_index(HM172Map *map, Node **bucket) {
+    size_t length = 0, capacity = 1;
+    for (Node *node = *bucket; node != NULL; node = node->next) length++;
+    while (capacity < 4 * length) capacity *= 2;
+    if (map->index_seed == 0) map->index_seed = hm172_random_seed() | 1u; // odd, so that it's never drawn again
+    ChainIndex *index = new_index(map, capacity, map->index_seed);
+    if (index == NULL) return;
+    Node *previous = NULL;
+    for (Node *node = *bucket; node != NULL; previous = node, node = node->next)
+        add_slot(index, node, previous, hash_secondary(index, hm172_entry_key(&node->entry), node->entry.key_length));
+    index->head = *bucket;
+    *bucket = (Node *) ((uintptr_t) index | 1u);
+}
+
+/*
+ * Doubles the index of the bucket, returns false if memory can't be allocated
+ */
+static bool grow_index(HM172Map *map, Node **bucket) {
+    ChainIndex *index = get_index(*bucket);
+    ChainIndex *grown = new_index(map, index->capacity * 2, index->seed);
+    if (grown == NULL) return false;
+    for (size_t i = 0; i < index->capacity; i++)
+        if (index->slots[i].node != NULL)
+            add_slot(grown, index->slots[i].node, index->slots[i].previous, index->slots[i].hash);
+    grown->head = index->head;
+    hm172_deallocate(map, index, get_index_size(index->capacity));
+    *bucket = (Node *) ((uintptr_t) grown | 1u);
+    return true;
+}
+
+static bool init(HM172Map *map, size_t capacity) {
+    map->table = hm172_allocate_zeroed(map, capacity * sizeof(Node *));
+    if (map->table == NULL) return false;
+    map->capacity = capacity;
+    return true;
+}
+
+static void drop_indices(HM172Map *map, Node **table, size_t capacity) {
+    for (size_t i = 0; i < capacity; i++) drop_index(map, table + i);
+}
+
+static void destroy(HM172Map *map) {
+    // the nodes of arena maps aren't cleared before, but the indices are always allocated separately
+    drop_indices(map, get_table(map), map->capacity);
+    if (map->old_table != NULL) drop_indices(map, (Node **) map->old_table, map->old_capacity);
+    hm172_deallocate(map, map->table, map->capacity * sizeof(Node *));
+    hm172_deallocate(map, map->old_table, map->old_capacity * sizeof(Node *));
+}
+
+static void start_resize(HM172Map *map, size_t new_capacity) {
+    Node **new_table = hm172_allocate_zeroed(map, new_capacity * sizeof(Node *));
+    if (new_table == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "resized table"};
+        return;
+    }
+    map->old_table = map->table;
+    map->old_capacity = map->capacity;
+    map->migrated_bucket_count = 0;
+    map->table = new_table;
+    map->capacity = new_capacity;
+}
+
+/*
+ * Indexes the plain chain of the bucket if it's long, so that the lookups in a table that has stopped growing
+ * don't walk the chains the migration has relinked
+ */
+static void reindex_bucket(HM172Map *map, Node **bucket) {
+    if (is_indexed(*bucket)) return;
+    size_t length = 0;
+    for (Node *node = *bucket; node != NULL && length < INDEX_THRESHOLD; node = node->next) length++;
+    if (length >= INDEX_THRESHOLD) build_index(map, bucket);
+}
+
+/*
+ * The old chain is reversed, and then each of its nodes is prepended to the new chain of its hash,
+ * so the nodes keep their order and precede the nodes already inserted to the new table
+ * A table grown k times spreads an old chain over the k new chains index + i * old_capacity,
+ * which are the only ones a growing migration touches, and a shrinking table maps several old chains
+ * to the same new one
+ * The indices of the relinked chains are dropped and built again for the long ones
+ */
+static void migrate_bucket(HM172Map *map, size_t index) {
+    Node **old_table = (Node **) map->old_table;
+    Node **table = get_table(map);
+    drop_index(map, old_table + index);
+    Node *reversed = NULL;
+    for (Node *node = old_table[index], *next; node != NULL; node = next) {
+        next = node->next;
+        node->next = reversed;
+        reversed = node;
+    }
+    if (reversed == NULL) return;
+    old_table[index] = NULL;
+    for (Node *node = reversed, *next; node != NULL; node = next) {
+        next = node->next;
+        Node **bucket = table + ((map->capacity - 1) & node->entry.hash);
+        drop_index(map, bucket);
+        node->next = *bucket;
+        *bucket = node;
+    }
+    for (size_t i = index & (map->capacity - 1); i < map->capacity; i += map->old_capacity)
+        reindex_bucket(map, table + i);
+}
+
+static void migrate(HM172Map *map, size_t bucket_count) {
+    size_t end = map->old_capacity - map->migrated_bucket_count > bucket_count
+                 ? map->migrated_bucket_count + bucket_count : map->old_capacity;
+    for (; map->migrated_bucket_count < end; map->migrated_bucket_count++)
+        migrate_bucket(map, map->migrated_bucket_count);
+    if (map->migrated_bucket_count == map->old_capacity) {
+        hm172_deallocate(map, map->old_table, map->old_capacity * sizeof(Node *));
+        map->old_table = NULL;
+    }
+}
+
+/*
+ * Adds the number of compared nodes to *probe_count
+ */
+static HM172Entry *find_in_chain(Node *node, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                 size_t *probe_count) {
+    for (; node != NULL; node = node->next) {
+        (*probe_count)++;
+        if (node->entry.hash == hash && hm172_entry_has_key(&node->entry, key, key_length)) return &node->entry;
+    }
+    return NULL;
+}
+
+static HM172Entry *find_in_bucket(Node *bucket, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                  size_t *probe_count) {
+    if (!is_indexed(bucket)) return find_in_chain(bucket, key, key_length, hash, probe_count);
+    ChainIndex *index = get_index(bucket);
+    IndexSlot *slot = find_slot(index, key, key_length, hash, hash_secondary(index, key, key_length), probe_count);
+    return slot->node == NULL ? NULL : &slot->node->entry;
+}
+
+static HM172Entry *find_in_old_table(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                     size_t *probe_count) {
+    size_t old_index = (map->old_capacity - 1) & hash;
+    if (old_index < map->migrated_bucket_count) return NULL;
+    return find_in_bucket(((Node **) map->old_table)[old_index], key, key_length, hash, probe_count);
+}
+
+static HM172Entry *find(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash) {
+    size_t probe_count = 0;
+    HM172Entry *entry = find_in_bucket(get_table(map)[(map->capacity - 1) & hash], key, key_length, hash, &probe_count);
+    if (entry == NULL && map->old_table != NULL) entry = find_in_old_table(map, key, key_length, hash, &probe_count);
+    hm172_record_lookup(map, probe_count, entry != NULL);
+    return entry;
+}
+
+/*
+ * Stages: the bucket, the first node of the chain, the key of the first node if it isn't inline
+ * Indexed chains are only prefetched up to the bucket
+ */
+static void prefetch(HM172Map *map, HM172Hash hash, unsigned stage) {
+    Node **bucket = get_table(map) + ((map->capacity - 1) & hash);
+    if (stage == 0) {
+        PREFETCH(bucket);
+        return;
+    }
+    Node *node = *bucket;
+    if (node == NULL || is_indexed(node)) return;
+    if (stage == 1) PREFETCH(node);
+    else if (!hm172_is_key_inline(node->entry.key_length)) PREFETCH(node->entry.key);
+}
+
+/*
+ * Prepends the node with the key, which isn't set to the node yet, to the indexed chain,
+ * dropping the index if it can't be grown
+ */
+static void add_to_index(HM172Map *map, Node **bucket, Node *node, HM172ConstKey key, size_t key_length) {
+    ChainIndex *index = get_index(*bucket);
+    if (2 * (index->size + 1) > index->capacity) {
+        if (!grow_index(map, bucket)) {
+            drop_index(map, bucket);
+            node->next = *bucket;
+            *bucket = node;
+            return;
+        }
+        index = get_index(*bucket);
+    }
+    if (index->head != NULL) find_node_slot(index, index->head)->previous = node;
+    add_slot(index, node, NULL, hash_secondary(index, key, key_length));
+    node->next = index->head;
+    index->head = node;
+}
+
+/*
+ * The key of the new node is set by the caller, so a long chain is indexed before the node is added to it
+ */
+static HM172Entry *find_or_insert(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                  bool *inserted) {
+    Node **bucket = get_table(map) + ((map->capacity - 1) & hash);
+    size_t probe_count = 0;
+    HM172Entry *entry = find_in_bucket(*bucket, key, key_length, hash, &probe_count);
+    size_t chain_probe_count = probe_count;
+    if (entry == NULL && map->old_table != NULL) entry = find_in_old_table(map, key, key_length, hash, &probe_count);
+    hm172_record_lookup(map, probe_count, entry != NULL);
+    *inserted = entry == NULL;
+    if (entry != NULL) return entry;
+    Node *node = hm172_alloc_node(map, sizeof(Node));
+    if (node == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "entry"};
+        return NULL;
+    }
+    node->entry.hash = hash;
+    if (!is_indexed(*bucket) && chain_probe_count >= INDEX_THRESHOLD) build_index(map, bucket);
+    if (is_indexed(*bucket)) {
+        add_to_index(map, bucket, node, key, key_length);
+    } else {
+        node->next = *bucket;
+        *bucket = node;
+    }
+    return &node->entry;
+}
+
+/*
+ * The key of the node isn't set, so it can't be found in the index, which is dropped instead
+ */
+static void undo_insert(HM172Map *map, HM172Entry *entry) {
+    Node **chain = get_table(map) + ((map->capacity - 1) & entry->hash);
+    drop_index(map, chain);
+    Node *node = *chain; // new nodes are prepended
+    *chain = node->next;
+    hm172_free_node(map, node, sizeof(Node));
+}
+
+/*
+ * Adds the number of compared nodes to *probe_count
+ */
+static bool remove_from_chain(HM172Map *map, Node **link, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                              HM172Entry *removed, size_t *probe_count) {
+    for (; *link != NULL; link = &(*link)->next) {
+        Node *node = *link;
+        (*probe_count)++;
+        if (node->entry.hash == hash && hm172_entry_has_key(&node->entry, key, key_length)) {
+            *link = node->next;
+            *removed = node->entry;
+            hm172_free_node(map, node, sizeof(Node));
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The node is unlinked from the chain through the node linking to it, which is kept in its index slot
+ */
+static bool remove_from_bucket(HM172Map *map, Node **bucket, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                               HM172Entry *removed, size_t *probe_count) {
+    if (!is_indexed(*bucket)) return remove_from_chain(map, bucket, key, key_length, hash, removed, probe_count);
+    ChainIndex *index = get_index(*bucket);
+    IndexSlot *slot = find_slot(index, key, key_length, hash, hash_secondary(index, key, key_length), probe_count);
+    Node *node = slot->node;
+    if (node == NULL) return false;
+    Node *previous = slot->previous;
+    if (previous == NULL) index->head = node->next;
+    else previous->next = node->next;
+    if (node->next != NULL) find_node_slot(index, node->next)->previous = previous;
+    erase_slot(index, slot);
+    *removed = node->entry;
+    hm172_free_node(map, node, sizeof(Node));
+    return true;
+}
+
+static bool remove_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, HM172Entry *removed) {
+    size_t probe_count = 0;
+    bool found = remove_from_bucket(map, get_table(map) + ((map->capacity - 1) & hash), key, key_length, hash,
+                                   removed, &probe_count);
+    if (!found && map->old_table != NULL) {
+        size_t old_index = (map->old_capacity - 1) & hash;
+        if (old_index >= map->migrated_bucket_count)
+            found = remove_from_bucket(map, (Node **) map->old_table + old_index, key, key_length, hash,
+                                      removed, &probe_count);
+    }
+    hm172_record_lookup(map, probe_count, found);
+    return found;
+}
+
+static void move_nodes(HM172Map *map, HM172Arena *arena) {
+    Node **table = get_table(map);
+    for (size_t i = 0; i < map->capacity; i++) {
+        drop_index(map, table + i);
+        for (Node **link = table + i; *link != NULL; link = &(*link)->next) {
+            Node *node = hm172_arena_alloc(arena, sizeof(Node), sizeof(void *));
+            *node = **link;
+            *link = node;
+        }
+    }
+}
+
+static void clear_table(HM172Map *map, Node **table, size_t capacity,
+                        void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    drop_indices(map, table, capacity);
+    if (free_key == NULL) {
+        memset(table, 0, capacity * sizeof(Node *));
+        return;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        Node *node = table[i];
+        if (node != NULL) {
+            table[i] = NULL;
+            do {
+                free_key(map, &node->entry);
+                Node *next = node->next;
+                hm172_free_node(map, node, sizeof(Node));
+                node = next;
+            } while (node != NULL);
+        }
+    }
+}
+
+static void clear(HM172Map *map, void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    clear_table(map, get_table(map), map->capacity, free_key);
+    if (map->old_table != NULL) {
+        clear_table(map, (Node **) map->old_table, map->old_capacity, free_key);
+        hm172_deallocate(map, map->old_table, map->old_capacity * sizeof(Node *));
+        map->old_table = NULL;
+    }
+}
+
+/*
+ * Iteration positions are buckets, indices below the old capacity refer to the old table buckets
+ * while a resize is in progress
+ */
+static size_t get_iteration_length(HM172Map *map) {
+    return (map->old_table == NULL ? 0 : map->old_capacity) + map->capacity;
+}
+
+static void advance_next_index(HM172EntryIterator *iterator) {
+    HM172Map *map = iterator->map;
+    size_t old_capacity = map->old_table == NULL ? 0 : map->old_capacity;
+    while (iterator->next_node == NULL && iterator->next_index < iterator->end_index) {
+        size_t index = iterator->next_index++;
+        Node **bucket = index < old_capacity ? (Node **) map->old_table + index
+                                             : get_table(map) + index - old_capacity;
+        iterator->next_node = *get_chain(bucket);
+    }
+}
+
+static void start_iteration(HM172EntryIterator *iterator) {
+    iterator->next_node = NULL;
+    advance_next_index(iterator);
+}
+
+static HM172Entry *next_entry(HM172EntryIterator *iterator) {
+    Node *current = iterator->next_node;
+    if (current == NULL) return NULL;
+    if ((iterator->next_node = current->next) == NULL)
+        advance_next_index(iterator);
+    return &current->entry;
+}
+
+static size_t count_chains(Node **table, size_t capacity, size_t *indexed_chain_count) {
+    size_t chain_count = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i] != NULL) chain_count++;
+        if (is_indexed(table[i])) (*indexed_chain_count)++;
+    }
+    return chain_count;
+}
+
+static int fprint_stats(HM172Map *map, FILE *stream) {
+    size_t indexed_chain_count = 0;
+    size_t chain_count = count_chains(get_table(map), map->capacity, &indexed_chain_count);
+    if (map->old_table != NULL)
+        chain_count += count_chains((Node **) map->old_table, map->old_capacity, &indexed_chain_count);
+    if (map->old_table != NULL && fprintf(stream, "migrated old buckets: %zu of %zu\n",
+                                          map->migrated_bucket_count, map->old_capacity) < 0)
+        return -1;
+    if (indexed_chain_count != 0 && fprintf(stream, "indexed chain count: %zu\n", indexed_chain_count) < 0)
+        return -1;
+    return fprintf(stream, "chain count: %zu\n"
+                           "average chain length: %f\n",
+                   chain_count, map->size / (float) chain_count);
+}
+
+const engine_t hm172_chained_engine = {
+        init, destroy, start_resize, migrate, find, prefetch, find_or_insert, undo_insert, remove_entry, move_nodes, clear,
+        get_iteration_length, start_iteration, next_entry, fprint_stats,
+        1, sizeof(Node *), sizeof(Node), -1
+};
@@ -0,0 +1,310 @@
+#include <malloc.h>
+#include <memory.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "concurrent_map.h"
+
+#define CACHE_LINE_SIZE 64
+
+static const size_t DEFAULT_SEGMENT_COUNT = 64;
+static const unsigned OPTIMISTIC_READ_ATTEMPTS = 8;
+
+typedef struct concurrent_node_t Node;
+
+struct concurrent_node_t {
+    _Atomic(Node *) next;
+    HM172Hash hash;
+    _Atomic HM172Value value;
+    size_t key_length;
+    char key[]; // followed by '\0'
+};
+
+typedef struct concurrent_table_t Table;
+
+struct concurrent_table_t {
+    Table *retired; // the table this one has replaced, kept for the readers that may still traverse it
+    size_t capacity; // must be a power of 2, can't be 0
+    _Atomic(Node *) buckets[];
+};
+
+/*
+ * Writers of a segment are serialized by its lock
+ * Readers take no locks: inserted nodes are published fully initialized by a single release store to the bucket,
+ * and a resize, which relinks existing nodes, makes the sequence odd while it is in progress,
+ * so that a reader that could have missed a node because of the relinking sees the sequence changed and retries
+ * Each segment occupies its own cache lines, so that segments don't slow each other down by false sharing
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+    atomic_uint sequence;
+    _Atomic(Table *) table;
+    atomic_size_t size;
+    float threshold; // negative if resizing disabled
+} Segment;
+
+struct concurrent_map_t {
+    Segment *segments;
+    size_t segment_count; // must be a power of 2, can't be 0
+    float load_factor; // negative if resizing disabled
+    hash_n_function_t hash_function;
+    uint64_t hash_seed;
+};
+
+static Table *new_table(size_t capacity) {
+    Table *table = malloc(sizeof(Table) + capacity * sizeof(_Atomic(Node *)));
+    if (table == NULL) return NULL;
+    table->retired = NULL;
+    table->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++)
+        atomic_init(&table->buckets[i], NULL);
+    return table;
+}
+
+static size_t round_up_to_power_of_2(size_t number) {
+    size_t power = 1;
+    while (power < number && power <= SIZE_MAX / 2) power <<= 1u;
+    return power;
+}
+
+static void update_threshold(HM172ConcurrentMap *map, Segment *segment, size_t capacity) {
+    segment->threshold = (map->load_factor < 0 || capacity > SIZE_MAX / 2) ? -1 : capacity * map->load_factor;
+}
+
+/*
+ * Segments are selected by the high bits of the mixed hash, so that segment selection doesn't correlate
+ * with bucket selection, which uses the low bits of the hash
+ */
+static Segment *get_segment(HM172ConcurrentMap *map, HM172Hash hash) {
+    uint64_t mixed_hash = (uint64_t) hash * UINT64_C(0x9E3779B97F4A7C15);
+    return map->segments + ((mixed_hash >> 32u) & (map->segment_count - 1));
+}
+
+static bool has_key(Node *node, HM172ConstKey key, size_t length, HM172Hash hash) {
+    return node->hash == hash && node->key_length == length && memcmp(node->key, key, length) == 0;
+}
+
+static Node *find_in_table(Table *table, HM172ConstKey key, size_t length, HM172Hash hash) {
+    Node *node = atomic_load_explicit(&table->buckets[hash & (table->capacity - 1)], memory_order_acquire);
+    for (; node != NULL; node = atomic_load_explicit(&node->next, memory_order_acquire))
+        if (has_key(node, key, length, hash)) return node;
+    return NULL;
+}
+
+/*
+ * Looks the key up without locking
+ * Returns true if the result wasn't affected by a concurrent resize, *found is then the node with the key or NULL
+ * Found nodes are always valid: nodes never leave the map while it is shared
+ */
+static bool try_find(Segment *segment, HM172ConstKey key, size_t length, HM172Hash hash, Node **found) {
+    unsigned sequence = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+    if (sequence & 1u) return false;
+    *found = find_in_table(atomic_load_explicit(&segment->table, memory_order_acquire), key, length, hash);
+    if (*found != NULL) return true;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&segment->sequence, memory_order_relaxed) == sequence;
+}
+
+/*
+ * Falls back to locking if optimistic lookups keep being interrupted by resizes
+ */
+static Node *find(Segment *segment, HM172ConstKey key, size_t length, HM172Hash hash) {
+    Node *found;
+    for (unsigned attempt = 0; attempt < OPTIMISTIC_READ_ATTEMPTS; attempt++)
+        if (try_find(segment, key, length, hash, &found)) return found;
+    pthread_mutex_lock(&segment->lock);
+    found = find_in_table(atomic_load_explicit(&segment->table, memory_order_relaxed), key, length, hash);
+    pthread_mutex_unlock(&segment->lock);
+    return found;
+}
+
+/*
+ * Doubles the segment capacity splitting each chain into a low and a high half preserving the order
+ * The relinking only ever points nodes to the ones that followed them, so concurrent readers always reach a list end
+ * Must be called with the segment locked
+ */
+static HM172Status resize(HM172ConcurrentMap *map, Segment *segment) {
+    Table *table = atomic_load_explicit(&segment->table, memory_order_relaxed);
+    Table *resized_table = new_table(table->capacity << 1u);
+    if (resized_table == NULL) return (HM172Status) {STATUS_OUT_OF_MEMORY, "resized table"};
+    unsigned sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < table->capacity; i++) {
+        Node *lowHead = NULL, *lowTail = NULL, *highHead = NULL, *highTail = NULL;
+        Node *node = atomic_load_explicit(&table->buckets[i], memory_order_relaxed);
+        for (; node != NULL; node = atomic_load_explicit(&node->next, memory_order_relaxed)) {
+            if (node->hash & table->capacity) {
+                if (highTail == NULL) highHead = node;
+                else atomic_store_explicit(&highTail->next, node, memory_order_relaxed);
+                highTail = node;
+            } else {
+                if (lowTail == NULL) lowHead = node;
+                else atomic_store_explicit(&lowTail->next, node, memory_order_relaxed);
+                lowTail = node;
+            }
+        }
+        if (lowTail != NULL) {
+            atomic_store_explicit(&lowTail->next, NULL, memory_order_relaxed);
+            atomic_store_explicit(&resized_table->buckets[i], lowHead, memory_order_relaxed);
+        }
+        if (highTail != NULL) {
+            atomic_store_explicit(&highTail->next, NULL, memory_order_relaxed);
+            atomic_store_explicit(&resized_table->buckets[i + table->capacity], highHead, memory_order_relaxed);
+        }
+    }
+    resized_table->retired = table;
+    atomic_store_explicit(&segment->table, resized_table, memory_order_release);
+    atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+    update_threshold(map, segment, resized_table->capacity);
+    return (HM172Status) {STATUS_OK, NULL};
+}
+
+/*
+ * The key must not be present in the segment, which must be locked
+ */
+static HM172Status insert(HM172ConcurrentMap *map, Segment *segment, HM172ConstKey key, size_t length, HM172Hash hash,
+                          HM172Value value) {
+    Node *node = malloc(sizeof(Node) + length + 1);
+    if (node == NULL) return (HM172Status) {STATUS_OUT_OF_MEMORY, "entry"};
+    node->hash = hash;
+    atomic_init(&node->value, value);
+    node->key_length = length;
+    memcpy(node->key, key, length);
+    node->key[length] = '\0';
+    Table *table = atomic_load_explicit(&segment->table, memory_order_relaxed);
+    _Atomic(Node *) *bucket = &table->buckets[hash & (table->capacity - 1)];
+    atomic_init(&node->next, atomic_load_explicit(bucket, memory_order_relaxed));
+    atomic_store_explicit(bucket, node, memory_order_release);
+    size_t size = atomic_load_explicit(&segment->size, memory_order_relaxed) + 1;
+    atomic_store_explicit(&segment->size, size, memory_order_relaxed);
+    if (segment->threshold >= 0 && (float) size > segment->threshold) return resize(map, segment);
+    return (HM172Status) {STATUS_OK, NULL};
+}
+
+HM172Status hm172_concurrent_put(HM172ConcurrentMap *map, HM172ConstKey key, size_t length, HM172Value value) {
+    HM172Hash hash = map->hash_function(key, length, map->hash_seed);
+    Segment *segment = get_segment(map, hash);
+    HM172Status status = {STATUS_OK, NULL};
+    pthread_mutex_lock(&segment->lock);
+    Node *node = find_in_table(atomic_load_explicit(&segment->table, memory_order_relaxed), key, length, hash);
+    if (node != NULL) atomic_store_explicit(&node->value, value, memory_order_relaxed);
+    else status = insert(map, segment, key, length, hash, value);
+    pthread_mutex_unlock(&segment->lock);
+    return status;
+}
+
+bool hm172_concurrent_get(HM172ConcurrentMap *map, HM172ConstKey key, size_t length, HM172Value *value) {
+    HM172Hash hash = map->hash_function(key, length, map->hash_seed);
+    Node *node = find(get_segment(map, hash), key, length, hash);
+    if (node == NULL) return false;
+    *value = atomic_load_explicit(&node->value, memory_order_relaxed);
+    return true;
+}
+
+HM172Status hm172_concurrent_increment(HM172ConcurrentMap *map, HM172ConstKey key, size_t length, HM172Value delta,
+                                       HM172Value *result) {
+    HM172Hash hash = map->hash_function(key, length, map->hash_seed);
+    Segment *segment = get_segment(map, hash);
+    Node *node;
+    if (!try_find(segment, key, length, hash, &node) || node == NULL) {
+        pthread_mutex_lock(&segment->lock);
+        node = find_in_table(atomic_load_explicit(&segment->table, memory_order_relaxed), key, length, hash);
+        if (node == NULL) {
+            HM172Status status = insert(map, segment, key, length, hash, delta);
+            pthread_mutex_unlock(&segment->lock);
+            if (result != NULL && hm172_is_status_ok(&status)) *result = delta;
+            return status;
+        }
+        pthread_mutex_unlock(&segment->lock);
+    }
+    HM172Value value = atomic_fetch_add_explicit(&node->value, delta, memory_order_relaxed) + delta;
+    if (result != NULL) *result = value;
+    return (HM172Status) {STATUS_OK, NULL};
+}
+
+size_t hm172_concurrent_size(HM172ConcurrentMap *map) {
+    size_t size = 0;
+    for (size_t i = 0; i < map->segment_count; i++)
+        size += atomic_load_explicit(&map->segments[i].size, memory_order_relaxed);
+    return size;
+}
+
+static void free_retired_tables(Table *table) {
+    Table *retired = table->retired;
+    table->retired = NULL;
+    while (retired != NULL) {
+        Table *next = retired->retired;
+        free(retired);
+        retired = next;
+    }
+}
+
+void hm172_concurrent_clear(HM172ConcurrentMap *map) {
+    for (size_t i = 0; i < map->segment_count; i++) {
+        Segment *segment = map->segments + i;
+        Table *table = atomic_load_explicit(&segment->table, memory_order_relaxed);
+        for (size_t j = 0; j < table->capacity; j++) {
+            Node *node = atomic_load_explicit(&table->buckets[j], memory_order_relaxed);
+            atomic_store_explicit(&table->buckets[j], NULL, memory_order_relaxed);
+            while (node != NULL) {
+                Node *next = atomic_load_explicit(&node->next, memory_order_relaxed);
+                free(node);
+                node = next;
+            }
+        }
+        free_retired_tables(table);
+        atomic_store_explicit(&segment->size, 0, memory_order_relaxed);
+    }
+}
+
+/*
+ * Frees the first segment_count segments, which must be initialized
+ */
+static void free_segments(HM172ConcurrentMap *map, size_t segment_count) {
+    for (size_t i = 0; i < segment_count; i++) {
+        Segment *segment = map->segments + i;
+        free(atomic_load_explicit(&segment->table, memory_order_relaxed));
+        pthread_mutex_destroy(&segment->lock);
+    }
+    free(map->segments);
+}
+
+void hm172_concurrent_free(HM172ConcurrentMap *map) {
+    if (map != NULL) {
+        hm172_concurrent_clear(map);
+        free_segments(map, map->segment_count);
+        free(map);
+    }
+}
+
+HM172ConcurrentMap *hm172_new_concurrent_map(size_t capacity, float load_factor, size_t segment_count,
+                                             hash_n_function_t hash_function, uint64_t hash_seed) {
+    HM172ConcurrentMap *map = malloc(sizeof(HM172ConcurrentMap));
+    if (map == NULL) return NULL;
+    map->segment_count = round_up_to_power_of_2(segment_count == 0 ? DEFAULT_SEGMENT_COUNT : segment_count);
+    map->load_factor = load_factor < 0 ? -1 : load_factor;
+    map->hash_function = hash_function;
+    map->hash_seed = hash_seed;
+    map->segments = aligned_alloc(CACHE_LINE_SIZE, map->segment_count * sizeof(Segment));
+    if (map->segments == NULL) {
+        free(map);
+        return NULL;
+    }
+    size_t segment_capacity = round_up_to_power_of_2(capacity / map->segment_count);
+    for (size_t i = 0; i < map->segment_count; i++) {
+        Segment *segment = map->segments + i;
+        Table *table = new_table(segment_capacity);
+        if (table == NULL || pthread_mutex_init(&segment->lock, NULL) != 0) {
+            free(table);
+            free_segments(map, i);
+            free(map);
+            return NULL;
+        }
+        atomic_init(&segment->sequence, 0);
+        atomic_init(&segment->table, table);
+        atomic_init(&segment->size, 0);
+        update_threshold(map, segment, segment_capacity);
+    }
+    return map;
+}
@@ -0,0 +1,62 @@
+#ifndef HASHMAP_172_CONCURRENT_MAP_H
+#define HASHMAP_172_CONCURRENT_MAP_H
+
+#include "map.h"
+
+/*
+ * Thread-safe string-to-int map
+ * The keys are split into independently locked segments by hash, so writers of different segments don't contend,
+ * and lookups take no locks at all: they read optimistically and retry if a resize of the segment interferes
+ * Entries are never freed while the map is shared, and tables replaced by resizes are kept until hm172_concurrent_clear
+ * or hm172_concurrent_free, so readers never touch freed memory
+ */
+typedef struct concurrent_map_t HM172ConcurrentMap;
+
+/*
+ * Returns new HM172ConcurrentMap instance
+ * The capacity is split evenly between the segments, each of which is resized independently
+ * The segment count is rounded up to a power of 2, 0 means the default of 64
+ * If load_factor is negative, resizing is disabled
+ * If sufficient amount of memory can't be allocated, NULL is returned
+ */
+HM172ConcurrentMap *hm172_new_concurrent_map(size_t capacity, float load_factor, size_t segment_count,
+                                             hash_n_function_t hash_function, uint64_t hash_seed);
+
+/*
+ * Must not be called concurrently with any other function using the map
+ */
+void hm172_concurrent_free(HM172ConcurrentMap *map);
+
+/*
+ * Removes all of the mappings and frees the memory retained for the concurrent readers
+ * Must not be called concurrently with any other function using the map
+ */
+void hm172_concurrent_clear(HM172ConcurrentMap *map);
+
+/*
+ * Returns the number of mappings, which may be outdated by the time it is returned if the map is being modified
+ */
+size_t hm172_concurrent_size(HM172ConcurrentMap *map);
+
+/*
+ * Makes the map associate the value with the key of the given length
+ * Returns a status of OUT_OF_MEMORY type if sufficient amount of memory can't be allocated
+ */
+HM172Status hm172_concurrent_put(HM172ConcurrentMap *map, HM172ConstKey key, size_t length, HM172Value value);
+
+/*
+ * Returns true and sets *value to the value to which the key is mapped, or returns false if there's no mapping
+ * Takes no locks
+ */
+bool hm172_concurrent_get(HM172ConcurrentMap *map, HM172ConstKey key, size_t length, HM172Value *value);
+
+/*
+ * Atomically adds delta to the value to which the key is mapped, or maps the key to delta if there's no mapping
+ * If result isn't NULL, it is set to the resulting value
+ * Takes no locks if the key is already present
+ * Returns a status of OUT_OF_MEMORY type if sufficient amount of memory can't be allocated
+ */
+HM172Status hm172_concurrent_increment(HM172ConcurrentMap *map, HM172ConstKey key, size_t length, HM172Value delta,
+                                       HM172Value *result);
+
+#endif // HASHMAP_172_CONCURRENT_MAP_H
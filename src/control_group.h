@@ -0,0 +1,105 @@
+#ifndef HASHMAP_172_CONTROL_GROUP_H
+#define HASHMAP_172_CONTROL_GROUP_H
+
+/*
+ * Internal helpers for open addressing tables that keep a control byte per slot and probe them in groups
+ * A control byte is either CONTROL_EMPTY, CONTROL_DELETED or a 7 bit hash fingerprint of the occupying entry
+ * Group matching functions return a bitmask where i-th bit is set if i-th byte of the group matches
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define GROUP_WIDTH 16
+
+typedef uint8_t HM172Control;
+typedef uint32_t HM172GroupMask;
+
+static const HM172Control CONTROL_EMPTY = 0x80;
+static const HM172Control CONTROL_DELETED = 0xFE;
+
+/*
+ * Spreads the hash over 64 bits so that both the group index (low bits) and the fingerprint (high bits) are well mixed
+ * even for the hash functions that leave the high bits empty for short keys
+ */
+static inline uint64_t hm172_mix_hash(uint64_t hash) {
+    uint64_t mixed = hash * UINT64_C(0x9E3779B97F4A7C15);
+    return mixed ^ (mixed >> 32u);
+}
+
+static inline HM172Control hm172_fingerprint(uint64_t mixed_hash) {
+    return (HM172Control) (mixed_hash >> 57u);
+}
+
+static inline unsigned hm172_lowest_set_bit(HM172GroupMask mask) {
+    return (unsigned) __builtin_ctz(mask);
+}
+
+#if defined(__SSE2__)
+
+static inline HM172GroupMask hm172_match_byte(const HM172Control *group, HM172Control byte) {
+    __m128i controls = _mm_loadu_si128((const __m128i *) group);
+    return (HM172GroupMask) _mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8((char) byte)));
+}
+
+/*
+ * Both empty and deleted control bytes are the only ones with the highest bit set
+ */
+static inline HM172GroupMask hm172_match_empty_or_deleted(const HM172Control *group) {
+    return (HM172GroupMask) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+}
+
+#else
+
+static inline HM172GroupMask hm172_match_byte(const HM172Control *group, HM172Control byte) {
+    HM172GroupMask mask = 0;
+    for (unsigned i = 0; i < GROUP_WIDTH; i++)
+        mask |= (HM172GroupMask) (group[i] == byte) << i;
+    return mask;
+}
+
+static inline HM172GroupMask hm172_match_empty_or_deleted(const HM172Control *group) {
+    HM172GroupMask mask = 0;
+    for (unsigned i = 0; i < GROUP_WIDTH; i++)
+        mask |= (HM172GroupMask) (group[i] >> 7u) << i;
+    return mask;
+}
+
+#endif
+
+static inline HM172GroupMask hm172_match_empty(const HM172Control *group) {
+    return hm172_match_byte(group, CONTROL_EMPTY);
+}
+
+/*
+ * Returns the index of the first empty or deleted slot in the probe sequence of the mixed hash
+ * Groups are probed in triangular order, which visits each group exactly once as the group count is a power of 2
+ * There must be at least one such slot
+ */
+static inline size_t hm172_find_free_slot(const HM172Control *controls, size_t capacity, uint64_t mixed_hash) {
+    size_t group_mask = capacity / GROUP_WIDTH - 1;
+    size_t group = mixed_hash & group_mask;
+    for (size_t step = 1;; step++) {
+        HM172GroupMask mask = hm172_match_empty_or_deleted(controls + group * GROUP_WIDTH);
+        if (mask != 0) return group * GROUP_WIDTH + hm172_lowest_set_bit(mask);
+        group = (group + step) & group_mask;
+    }
+}
+
+/*
+ * A slot is marked empty rather than deleted if its group has an empty slot: lookups stop at such group,
+ * so no probe sequence needs to go past the slot
+ * Returns whether the slot is marked deleted
+ */
+static inline bool hm172_erase_control(HM172Control *controls, size_t index) {
+    bool deleted = hm172_match_empty(controls + index / GROUP_WIDTH * GROUP_WIDTH) == 0;
+    controls[index] = deleted ? CONTROL_DELETED : CONTROL_EMPTY;
+    return deleted;
+}
+
+#endif // HASHMAP_172_CONTROL_GROUP_H
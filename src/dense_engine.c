@@ -0,0 +1,311 @@
+#include <memory.h>
+#include "map_engine.h"
+#include "control_group.h"
+
+/*
+ * Dense storage: entries are appended to an array in insertion order, and the table is an open addressing index
+ * of their positions probed a group of control bytes at a time, so iteration is a linear scan of the array
+ * Removed entries are left in the array as holes, counted as deleted slots, until a resize compacts the array
+ * The index positions are followed by the control bytes in the same allocation
+ */
+
+static const size_t MIN_CAPACITY = GROUP_WIDTH;
+static const size_t MIN_ENTRY_CAPACITY = 16;
+static const size_t REMOVED_KEY_LENGTH = SIZE_MAX;
+
+typedef struct {
+    HM172Entry *entries; // in insertion order, including the removed ones
+    size_t entry_count;
+    size_t entry_capacity;
+    void *index;
+    size_t inserted_slot; // index slot of the last inserted entry and its control byte before the insertion
+    HM172Control inserted_slot_control;
+} DenseTable;
+
+static size_t *get_positions(void *index) {
+    return (size_t *) index;
+}
+
+static HM172Control *get_controls(void *index, size_t capacity) {
+    return (HM172Control *) (get_positions(index) + capacity);
+}
+
+static size_t get_index_size(size_t capacity) {
+    return capacity * (sizeof(size_t) + sizeof(HM172Control));
+}
+
+static void *new_index(HM172Map *map, size_t capacity) {
+    size_t *positions = hm172_allocate(map, get_index_size(capacity));
+    if (positions == NULL) return NULL;
+    memset(positions + capacity, CONTROL_EMPTY, capacity * sizeof(HM172Control));
+    return positions;
+}
+
+static bool is_removed(const HM172Entry *entry) {
+    return entry->key_length == REMOVED_KEY_LENGTH;
+}
+
+/*
+ * Moves the entries to a new array of the given capacity, the allocator has no realloc
+ * Returns false if memory can't be allocated, the entries are kept then
+ */
+static bool resize_entries(HM172Map *map, size_t entry_capacity) {
+    DenseTable *table = map->table;
+    HM172Entry *entries = hm172_allocate(map, entry_capacity * sizeof(HM172Entry));
+    if (entries == NULL) return false;
+    if (table->entry_count != 0) memcpy(entries, table->entries, table->entry_count * sizeof(HM172Entry));
+    hm172_deallocate(map, table->entries, table->entry_capacity * sizeof(HM172Entry));
+    table->entries = entries;
+    table->entry_capacity = entry_capacity;
+    return true;
+}
+
+static bool init(HM172Map *map, size_t capacity) {
+    DenseTable *table = hm172_allocate(map, sizeof(DenseTable));
+    if (table == NULL) return false;
+    table->index = new_index(map, capacity);
+    if (table->index == NULL) {
+        hm172_deallocate(map, table, sizeof(DenseTable));
+        return false;
+    }
+    table->entries = NULL;
+    table->entry_count = 0;
+    table->entry_capacity = 0;
+    map->table = table;
+    map->capacity = capacity;
+    return true;
+}
+
+static void destroy(HM172Map *map) {
+    DenseTable *table = map->table;
+    hm172_deallocate(map, table->entries, table->entry_capacity * sizeof(HM172Entry));
+    hm172_deallocate(map, table->index, get_index_size(map->capacity));
+    hm172_deallocate(map, table, sizeof(DenseTable));
+    hm172_deallocate(map, map->old_table, get_index_size(map->old_capacity));
+}
+
+/*
+ * Compacts the entries over the holes, keeping their order, and builds the whole new index at once,
+ * the old index becomes the old table only to be freed by migrate
+ */
+static void start_resize(HM172Map *map, size_t new_capacity) {
+    void *index = new_index(map, new_capacity);
+    if (index == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "resized table"};
+        return;
+    }
+    DenseTable *table = map->table;
+    size_t *positions = get_positions(index);
+    HM172Control *controls = get_controls(index, new_capacity);
+    size_t entry_count = 0;
+    for (size_t i = 0; i < table->entry_count; i++) {
+        if (is_removed(table->entries + i)) continue;
+        table->entries[entry_count] = table->entries[i];
+        uint64_t mixed_hash = hm172_mix_hash(table->entries[entry_count].hash);
+        size_t slot = hm172_find_free_slot(controls, new_capacity, mixed_hash);
+        controls[slot] = hm172_fingerprint(mixed_hash);
+        positions[slot] = entry_count++;
+    }
+    table->entry_count = entry_count;
+    if (entry_count < table->entry_capacity / 4 && table->entry_capacity > MIN_ENTRY_CAPACITY) {
+        size_t entry_capacity = entry_count * 2 > MIN_ENTRY_CAPACITY ? entry_count * 2 : MIN_ENTRY_CAPACITY;
+        resize_entries(map, entry_capacity);
+    }
+    map->old_table = table->index;
+    map->old_capacity = map->capacity;
+    map->migrated_bucket_count = 0;
+    table->index = index;
+    map->capacity = new_capacity;
+    map->deleted_count = 0;
+}
+
+static void migrate(HM172Map *map, size_t bucket_count) {
+    (void) bucket_count;
+    hm172_deallocate(map, map->old_table, get_index_size(map->old_capacity));
+    map->old_table = NULL;
+    map->migrated_bucket_count = map->old_capacity;
+}
+
+/*
+ * Returns the index slot holding the position of the entry with the given key and hash, or SIZE_MAX
+ */
+static size_t find_slot(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash) {
+    DenseTable *table = map->table;
+    size_t *positions = get_positions(table->index);
+    HM172Control *controls = get_controls(table->index, map->capacity);
+    uint64_t mixed_hash = hm172_mix_hash(hash);
+    HM172Control fingerprint = hm172_fingerprint(mixed_hash);
+    size_t group_count = map->capacity / GROUP_WIDTH;
+    size_t group = mixed_hash & (group_count - 1);
+    size_t probe_count = 0;
+    for (size_t step = 1; step <= group_count; step++) {
+        HM172Control *group_controls = controls + group * GROUP_WIDTH;
+        probe_count++;
+        for (HM172GroupMask mask = hm172_match_byte(group_controls, fingerprint); mask != 0; mask &= mask - 1) {
+            size_t slot = group * GROUP_WIDTH + hm172_lowest_set_bit(mask);
+            HM172Entry *entry = table->entries + positions[slot];
+            if (entry->hash == hash && hm172_entry_has_key(entry, key, key_length)) {
+                hm172_record_lookup(map, probe_count, true);
+                return slot;
+            }
+        }
+        if (hm172_match_empty(group_controls) != 0) break;
+        group = (group + step) & (group_count - 1);
+    }
+    hm172_record_lookup(map, probe_count, false);
+    return SIZE_MAX;
+}
+
+static HM172Entry *find(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash) {
+    DenseTable *table = map->table;
+    size_t slot = find_slot(map, key, key_length, hash);
+    return slot == SIZE_MAX ? NULL : table->entries + get_positions(table->index)[slot];
+}
+
+/*
+ * Stages: the control bytes of the first probed group, the position of the first slot with a matching fingerprint,
+ * the entry at that position
+ */
+static void prefetch(HM172Map *map, HM172Hash hash, unsigned stage) {
+    DenseTable *table = map->table;
+    uint64_t mixed_hash = hm172_mix_hash(hash);
+    size_t group_index = (mixed_hash & (map->capacity / GROUP_WIDTH - 1)) * GROUP_WIDTH;
+    HM172Control *group_controls = get_controls(table->index, map->capacity) + group_index;
+    if (stage == 0) {
+        PREFETCH(group_controls);
+        return;
+    }
+    HM172GroupMask mask = hm172_match_byte(group_controls, hm172_fingerprint(mixed_hash));
+    if (mask == 0) return;
+    size_t *position = get_positions(table->index) + group_index + hm172_lowest_set_bit(mask);
+    if (stage == 1) PREFETCH(position);
+    else PREFETCH(table->entries + *position);
+}
+
+static bool reserve_entry(HM172Map *map) {
+    DenseTable *table = map->table;
+    if (table->entry_count < table->entry_capacity) return true;
+    size_t entry_capacity = table->entry_capacity == 0 ? MIN_ENTRY_CAPACITY : table->entry_capacity * 2;
+    if (!resize_entries(map, entry_capacity)) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "entries"};
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Remembers the first empty or deleted slot while looking for the key, the new entry is appended to the array
+ * and its position goes to that slot
+ */
+static HM172Entry *find_or_insert(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                  bool *inserted) {
+    DenseTable *table = map->table;
+    size_t *positions = get_positions(table->index);
+    HM172Control *controls = get_controls(table->index, map->capacity);
+    uint64_t mixed_hash = hm172_mix_hash(hash);
+    HM172Control fingerprint = hm172_fingerprint(mixed_hash);
+    size_t group_count = map->capacity / GROUP_WIDTH;
+    size_t group = mixed_hash & (group_count - 1);
+    size_t free_slot = SIZE_MAX, probe_count = 0;
+    *inserted = false;
+    for (size_t step = 1; step <= group_count; step++) {
+        HM172Control *group_controls = controls + group * GROUP_WIDTH;
+        probe_count++;
+        for (HM172GroupMask mask = hm172_match_byte(group_controls, fingerprint); mask != 0; mask &= mask - 1) {
+            HM172Entry *entry = table->entries + positions[group * GROUP_WIDTH + hm172_lowest_set_bit(mask)];
+            if (entry->hash == hash && hm172_entry_has_key(entry, key, key_length)) {
+                hm172_record_lookup(map, probe_count, true);
+                return entry;
+            }
+        }
+        if (free_slot == SIZE_MAX) {
+            HM172GroupMask free_mask = hm172_match_empty_or_deleted(group_controls);
+            if (free_mask != 0) free_slot = group * GROUP_WIDTH + hm172_lowest_set_bit(free_mask);
+        }
+        if (hm172_match_empty(group_controls) != 0) break;
+        group = (group + step) & (group_count - 1);
+    }
+    hm172_record_lookup(map, probe_count, false);
+    if (free_slot == SIZE_MAX) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "table slot"};
+        return NULL;
+    }
+    if (!reserve_entry(map)) return NULL;
+    *inserted = true;
+    table->inserted_slot = free_slot;
+    table->inserted_slot_control = controls[free_slot];
+    controls[free_slot] = fingerprint;
+    positions[free_slot] = table->entry_count;
+    HM172Entry *entry = table->entries + table->entry_count++;
+    entry->hash = hash;
+    return entry;
+}
+
+/*
+ * The inserted entry is the last one, so it's dropped from the array rather than left as a hole
+ */
+static void undo_insert(HM172Map *map, HM172Entry *entry) {
+    (void) entry;
+    DenseTable *table = map->table;
+    get_controls(table->index, map->capacity)[table->inserted_slot] = table->inserted_slot_control;
+    table->entry_count--;
+}
+
+static bool remove_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, HM172Entry *removed) {
+    DenseTable *table = map->table;
+    size_t slot = find_slot(map, key, key_length, hash);
+    if (slot == SIZE_MAX) return false;
+    HM172Entry *entry = table->entries + get_positions(table->index)[slot];
+    *removed = *entry;
+    entry->key_length = REMOVED_KEY_LENGTH;
+    hm172_erase_control(get_controls(table->index, map->capacity), slot);
+    map->deleted_count++;
+    return true;
+}
+
+static void clear(HM172Map *map, void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    DenseTable *table = map->table;
+    if (free_key != NULL)
+        for (size_t i = 0; i < table->entry_count; i++)
+            if (!is_removed(table->entries + i)) free_key(map, table->entries + i);
+    table->entry_count = 0;
+    memset(get_controls(table->index, map->capacity), CONTROL_EMPTY, map->capacity * sizeof(HM172Control));
+    map->deleted_count = 0;
+    hm172_deallocate(map, map->old_table, get_index_size(map->old_capacity));
+    map->old_table = NULL;
+}
+
+/*
+ * Iteration positions are entry array positions, including the holes
+ */
+static size_t get_iteration_length(HM172Map *map) {
+    return ((DenseTable *) map->table)->entry_count;
+}
+
+static void start_iteration(HM172EntryIterator *iterator) {
+    (void) iterator;
+}
+
+static HM172Entry *next_entry(HM172EntryIterator *iterator) {
+    DenseTable *table = iterator->map->table;
+    while (iterator->next_index < iterator->end_index) {
+        HM172Entry *entry = table->entries + iterator->next_index++;
+        if (!is_removed(entry)) return entry;
+    }
+    return NULL;
+}
+
+static int fprint_stats(HM172Map *map, FILE *stream) {
+    DenseTable *table = map->table;
+    return fprintf(stream, "group count: %zu\n"
+                           "entry array length: %zu\n"
+                           "entry array capacity: %zu\n"
+                           "removed entry count: %zu\n",
+                   map->capacity / GROUP_WIDTH, table->entry_count, table->entry_capacity, map->deleted_count);
+}
+
+const engine_t hm172_dense_engine = {
+        init, destroy, start_resize, migrate, find, prefetch, find_or_insert, undo_insert, remove_entry, NULL, clear,
+        get_iteration_length, start_iteration, next_entry, fprint_stats,
+        MIN_CAPACITY, sizeof(size_t) + sizeof(HM172Control), sizeof(HM172Entry), 0.875f
+};
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <string.h>
+#include "tokenizer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * i-th bit is set if i-th byte of the block matches
+ */
+typedef uint32_t BlockMask;
+
+#if defined(__SSE2__)
+
+/*
+ * Signed comparison of bytes shifted by 128 - first is an unsigned range check: first <= byte < first + 26
+ */
+static __m128i match_alphabet(__m128i bytes, char first) {
+    __m128i shifted = _mm_add_epi8(bytes, _mm_set1_epi8((char) (128 - first)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char) (-128 + 26)));
+}
+
+/*
+ * Stores the block folded to lower case and returns the mask of its letters, setting *upper_case to the mask
+ * of its upper case letters
+ */
+static BlockMask classify_block(const char *block, char *folded, BlockMask *upper_case) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *) block);
+    __m128i upper = match_alphabet(bytes, 'A');
+    __m128i lower = _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    _mm_storeu_si128((__m128i *) folded, lower);
+    *upper_case = (BlockMask) _mm_movemask_epi8(upper);
+    return (BlockMask) _mm_movemask_epi8(match_alphabet(lower, 'a'));
+}
+
+#else
+
+static BlockMask classify_block(const char *block, char *folded, BlockMask *upper_case) {
+    BlockMask letters = 0, upper = 0;
+    for (unsigned i = 0; i < TOKENIZER_BLOCK_SIZE; i++) {
+        unsigned char byte = (unsigned char) block[i];
+        bool is_upper = (unsigned) (byte - 'A') < 26u;
+        unsigned char lower = is_upper ? byte | 0x20u : byte;
+        folded[i] = (char) lower;
+        upper |= (BlockMask) is_upper << i;
+        letters |= (BlockMask) ((unsigned) (lower - 'a') < 26u) << i;
+    }
+    *upper_case = upper;
+    return letters;
+}
+
+#endif
+
+/*
+ * Returns the block starting at the cursor, copied to the padding buffer if fewer than a block of bytes is left
+ */
+static const char *load_block(const char *cursor, const char *end, char *padding) {
+    if ((size_t) (end - cursor) >= TOKENIZER_BLOCK_SIZE) return cursor;
+    memset(padding, 0, TOKENIZER_BLOCK_SIZE);
+    memcpy(padding, cursor, (size_t) (end - cursor));
+    return padding;
+}
+
+static BlockMask get_prefix_mask(size_t length) {
+    return ((BlockMask) 1 << length) - 1;
+}
+
+static size_t min_size(size_t first, size_t second) {
+    return first < second ? first : second;
+}
+
+void init_tokenizer(WordTokenizer *tokenizer) {
+    tokenizer->cursor = NULL;
+    tokenizer->end = NULL;
+    tokenizer->is_last_part = false;
+    tokenizer->pending_length = 0;
+}
+
+void feed_tokenizer(WordTokenizer *tokenizer, const char *begin, const char *end, bool is_last_part) {
+    tokenizer->cursor = begin;
+    tokenizer->end = end;
+    tokenizer->is_last_part = is_last_part;
+}
+
+/*
+ * Moves the cursor to the next letter, returns false if the part has no more letters
+ */
+static bool skip_non_letters(WordTokenizer *tokenizer) {
+    char padding[TOKENIZER_BLOCK_SIZE];
+    BlockMask upper_case;
+    while (tokenizer->cursor != tokenizer->end) {
+        size_t length = min_size((size_t) (tokenizer->end - tokenizer->cursor), TOKENIZER_BLOCK_SIZE);
+        const char *block = load_block(tokenizer->cursor, tokenizer->end, padding);
+        BlockMask letters = classify_block(block, tokenizer->word, &upper_case) & get_prefix_mask(length);
+        if (letters != 0) {
+            tokenizer->cursor += __builtin_ctz(letters);
+            return true;
+        }
+        tokenizer->cursor += length;
+    }
+    return false;
+}
+
+/*
+ * Each block is folded to the word buffer, the view of the text is returned instead if no letter needed folding
+ */
+bool next_word(WordTokenizer *tokenizer, const char **word, size_t *length) {
+    if (tokenizer->pending_length == 0 && !skip_non_letters(tokenizer)) return false;
+    char padding[TOKENIZER_BLOCK_SIZE];
+    const char *begin = tokenizer->cursor;
+    size_t word_length = tokenizer->pending_length;
+    bool is_folded = word_length != 0;
+    for (;;) {
+        size_t block_length = min_size(min_size((size_t) (tokenizer->end - tokenizer->cursor), TOKENIZER_BLOCK_SIZE),
+                                       MAX_WORD_LENGTH - 1 - word_length);
+        if (block_length == 0) break;
+        BlockMask upper_case;
+        const char *block = load_block(tokenizer->cursor, tokenizer->end, padding);
+        BlockMask non_letters = ~classify_block(block, tokenizer->word + word_length, &upper_case)
+                                & get_prefix_mask(block_length);
+        size_t letter_count = non_letters == 0 ? block_length : (size_t) __builtin_ctz(non_letters);
+        if (upper_case & get_prefix_mask(letter_count)) is_folded = true;
+        word_length += letter_count;
+        tokenizer->cursor += letter_count;
+        if (letter_count < block_length) break;
+    }
+    if (tokenizer->cursor == tokenizer->end && !tokenizer->is_last_part && word_length < MAX_WORD_LENGTH - 1) {
+        tokenizer->pending_length = word_length;
+        return false;
+    }
+    tokenizer->pending_length = 0;
+    *word = is_folded ? tokenizer->word : begin;
+    *length = word_length;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef HASHMAP_172_TOKENIZER_H
+#define HASHMAP_172_TOKENIZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_WORD_LENGTH 1024 // including '\0' the words of which used to be read to buffers
+#define TOKENIZER_BLOCK_SIZE 16
+
+/*
+ * Splits text into words, the runs of ASCII letters folded to lower case, classifying and folding
+ * a block of TOKENIZER_BLOCK_SIZE bytes at a time with SSE2 where available
+ * Runs longer than MAX_WORD_LENGTH - 1 letters are split into several words
+ * The text can be fed in parts, e.g. read buffers, a word that continues in the next part is kept by the tokenizer
+ */
+typedef struct {
+    const char *cursor;
+    const char *end;
+    bool is_last_part;
+    size_t pending_length; // letters of the word that continues in the next part, stored folded in the word buffer
+    char word[MAX_WORD_LENGTH + TOKENIZER_BLOCK_SIZE]; // folded words, with space for a whole block past the end
+} WordTokenizer;
+
+void init_tokenizer(WordTokenizer *tokenizer);
+
+/*
+ * Makes the tokenizer split the text from begin to end, which must stay unchanged while its words are read
+ */
+void feed_tokenizer(WordTokenizer *tokenizer, const char *begin, const char *end, bool is_last_part);
+
+/*
+ * Sets *word to the next word and *length to its length, and returns true,
+ * or returns false if the fed part has no more complete words
+ * The word is a view of either the fed text, if it has no upper case letters, or the tokenizer word buffer,
+ * so it isn't followed by '\0' and is only valid until the next call
+ */
+bool next_word(WordTokenizer *tokenizer, const char **word, size_t *length);
+
+#endif // HASHMAP_172_TOKENIZER_H
@@ -1,19 +1,125 @@
 #include <stdio.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <ctype.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../status.h"
 #include "../map.h"
 #include "../hash_functions.h"
+#include "../ranking.h"
+#include "tokenizer.h"
 
-#define MAX_WORD_LENGTH 1024
+#define READ_BUFFER_SIZE (1u << 16u)
+#define MAX_LIST_LENGTH 64
+#define HASH_COUNT 3
 
 static const int MIN_ARG_COUNT = 1 + 4;
 static const int INPUT_FILE_ARG_INDEX = 1;
 static const int OUTPUT_FILE_ARG_INDEX = 2;
 static const int LOAD_FACTOR_ARG_INDEX = 3;
 static const int FIRST_CAPACITY_ARG_INDEX = 4;
+static const char *THREAD_COUNT_OPTION = "--threads";
+static const char *SWEEP_OPTION = "--sweep";
+static const char *JOB_COUNT_OPTION = "--jobs";
+static const char *ENGINES_OPTION = "--engines";
+static const char *HASHES_OPTION = "--hashes";
+static const uint64_t SWEEP_HASH_SEED = 172;
+
+static const char *const ENGINE_NAMES[] = {"chained", "open-addressing", "dense"}; // indexed by HM172Engine
+static const char *const HASH_NAMES[] = {"polynomial", "mum", "stripe"};
+static const hash_n_function_t HASH_N_FUNCTIONS[HASH_COUNT] = {
+        hm172_polynomial_hash_n, hm172_mum_hash, hm172_stripe_hash
+};
+
+/*
+ * The lines of hm172_fprint_stats output reported as CSV columns, left empty for the engines that don't print them
+ */
+static const char *const STATS_NAMES[] = {
+        "chain count", "average chain length", "indexed chain count", "average probe length", "max probe length"
+};
+static const char *STATS_COLUMNS = "chain_count,average_chain_length,indexed_chain_count,average_probe_length,"
+                                   "max_probe_length";
+
+/*
+ * Words are read either from the file sequentially or, if data isn't NULL, from the memory mapped file by thread_count threads
+ */
+typedef struct {
+    FILE *file;
+    const char *data;
+    size_t size;
+    size_t thread_count;
+} WordSource;
+
+typedef struct {
+    const char *begin;
+    const char *end;
+    size_t init_capacity;
+    float load_factor;
+    HM172Map *word_to_count_map; // NULL if the task has failed
+} CountTask;
+
+typedef struct {
+    size_t count;
+    size_t values[MAX_LIST_LENGTH];
+} SizeList;
+
+typedef struct {
+    size_t count;
+    float values[MAX_LIST_LENGTH];
+} FloatList;
+
+/*
+ * The words of the input in order, as indices of the distinct words, which are stored once together with their
+ * hashes by each swept hash function, so that replaying the trace neither reads, tokenizes nor hashes the input
+ */
+typedef struct {
+    char *word_data; // distinct words one after another, not followed by '\0'
+    size_t *word_offsets; // of the distinct words in word_data, followed by the end of the last one
+    size_t word_count; // of the distinct words
+    uint32_t *word_indices;
+    size_t length;
+    HM172Hash *hashes[HASH_COUNT]; // of the distinct words, NULL for the hash functions that aren't swept
+    double hash_ns_per_word[HASH_COUNT]; // hashing time of the whole trace, which replays don't include
+} WordTrace;
+
+/*
+ * Bytes held by a map through a counting allocator, so that the peak memory of each configuration is known
+ * even if the configurations are replayed in parallel
+ */
+typedef struct {
+    size_t bytes;
+    size_t peak_bytes;
+} MemoryCounter;
+
+typedef struct {
+    HM172MapOptions map_options;
+    size_t hash_index;
+    MemoryCounter memory;
+    double seconds; // of the replay
+    size_t unique_word_count;
+    size_t final_bytes;
+    char *stats; // hm172_fprint_stats output, NULL if the replay has failed
+} SweepConfig;
+
+typedef struct {
+    const WordTrace *trace;
+    SweepConfig *configs;
+    size_t config_count;
+    size_t next_config; // guarded by the mutex
+    pthread_mutex_t mutex;
+} SweepQueue;
+
+/*
+ * Hashes are combined here, so that hashing the trace isn't optimized out
+ */
+volatile HM172Hash hash_sink;
 
 int str_to_size_t(char *str, size_t *result, const char *variable_name) {
     char *endptr;
@@ -40,61 +146,207 @@ int str_to_float(char *str, float *result, const char *variable_name) {
     return 0;
 }
 
-char *fread_word(FILE *stream, char *buffer, size_t buffer_length) {
-    int ch;
-    while (!isalpha(ch = fgetc(stream)))
-        if (ch == EOF) return NULL;
-    size_t i;
-    for (i = 0; i < buffer_length - 1 && isalpha(ch); i++) {
-        buffer[i] = (char) tolower(ch);
-        ch = fgetc(stream);
+/*
+ * Parses comma separated numbers, the str is modified
+ */
+int parse_float_list(char *str, FloatList *list, const char *variable_name) {
+    list->count = 0;
+    for (char *item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (list->count == MAX_LIST_LENGTH) {
+            LOG_ERROR("Invalid %s. At most %d values are allowed\n", variable_name, MAX_LIST_LENGTH);
+            return -1;
+        }
+        if (str_to_float(item, &list->values[list->count++], variable_name) != 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ * Parses comma separated names into their indices in the names array, the str is modified
+ */
+int parse_name_list(char *str, const char *const names[], size_t name_count, SizeList *list,
+                    const char *variable_name) {
+    list->count = 0;
+    for (char *item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        size_t index = 0;
+        while (index < name_count && strcmp(item, names[index]) != 0) index++;
+        if (index == name_count) {
+            LOG_ERROR("Invalid %s. Unknown name \"%s\"\n", variable_name, item);
+            return -1;
+        }
+        if (list->count == MAX_LIST_LENGTH) {
+            LOG_ERROR("Invalid %s. At most %d values are allowed\n", variable_name, MAX_LIST_LENGTH);
+            return -1;
+        }
+        list->values[list->count++] = index;
+    }
+    return 0;
+}
+
+/*
+ * Counts the complete words of the part fed to the tokenizer, each word view is hashed and looked up in place
+ * Returns -1 and logs error if the map can't be updated
+ */
+int count_words(WordTokenizer *tokenizer, HM172Map *word_to_count_map) {
+    const char *word;
+    size_t length;
+    while (next_word(tokenizer, &word, &length)) {
+        int *count_ptr = hm172_get_or_put_n(word_to_count_map, word, length, 0, NULL);
+        if (hm172_log_on_error(word_to_count_map)) return -1;
+        (*count_ptr)++;
     }
-    buffer[i] = '\0';
-    ungetc(ch, stream);
-    return buffer;
+    return 0;
 }
 
 HM172Map *get_word_to_count_map(FILE *file, size_t init_capacity, float load_factor) {
+    char *buffer = malloc(READ_BUFFER_SIZE);
+    WordTokenizer *tokenizer = malloc(sizeof(WordTokenizer));
     HM172Map *word_to_count_map = hm172_new_map(init_capacity, load_factor, hm172_polynomial_hash);
-    if (word_to_count_map == NULL) {
+    if (buffer == NULL || tokenizer == NULL || word_to_count_map == NULL) {
+        LOG_ERROR("Unable to allocate memory for word to count map\n");
+        free(buffer);
+        free(tokenizer);
+        hm172_free(word_to_count_map);
+        return NULL;
+    }
+    init_tokenizer(tokenizer);
+    bool is_last_part = false;
+    while (!is_last_part) {
+        size_t read_size = fread(buffer, 1, READ_BUFFER_SIZE, file);
+        is_last_part = read_size < READ_BUFFER_SIZE;
+        if (is_last_part && ferror(file)) {
+            LOG_ERROR("Unable to read input file\n");
+            hm172_free(word_to_count_map);
+            word_to_count_map = NULL;
+            break;
+        }
+        feed_tokenizer(tokenizer, buffer, buffer + read_size, is_last_part);
+        if (count_words(tokenizer, word_to_count_map) != 0) {
+            hm172_free(word_to_count_map);
+            word_to_count_map = NULL;
+            break;
+        }
+    }
+    free(buffer);
+    free(tokenizer);
+    return word_to_count_map;
+}
+
+void *count_words_task(void *task_ptr) {
+    CountTask *task = task_ptr;
+    WordTokenizer *tokenizer = malloc(sizeof(WordTokenizer));
+    task->word_to_count_map = hm172_new_map(task->init_capacity, task->load_factor, hm172_polynomial_hash);
+    if (tokenizer == NULL || task->word_to_count_map == NULL) {
         LOG_ERROR("Unable to allocate memory for word to count map\n");
+        free(tokenizer);
+        hm172_free(task->word_to_count_map);
+        task->word_to_count_map = NULL;
         return NULL;
     }
-    char word[MAX_WORD_LENGTH];
-    while (fread_word(file, word, MAX_WORD_LENGTH) != NULL) {
-        int *count_ptr = hm172_get(word_to_count_map, word);
-        if (count_ptr == NULL) {
-            hm172_put(word_to_count_map, word, 1);
-            if (hm172_log_and_free_on_error(word_to_count_map)) return NULL;
-        } else (*count_ptr)++;
+    init_tokenizer(tokenizer);
+    feed_tokenizer(tokenizer, task->begin, task->end, true);
+    if (count_words(tokenizer, task->word_to_count_map) != 0) {
+        hm172_free(task->word_to_count_map);
+        task->word_to_count_map = NULL;
+    }
+    free(tokenizer);
+    return NULL;
+}
+
+HM172Value add_counts(HM172Value count, HM172Value other_count) {
+    return count + other_count;
+}
+
+/*
+ * Returns the chunk end nearest to the position that doesn't split a word
+ */
+const char *find_chunk_end(const char *data, size_t size, size_t position) {
+    while (position > 0 && position < size && isalpha((unsigned char) data[position - 1])
+           && isalpha((unsigned char) data[position]))
+        position++;
+    return data + position;
+}
+
+/*
+ * Splits the data into chunks at word boundaries, counts words of each chunk into a separate map in a separate thread,
+ * and merges the maps into the first one
+ */
+HM172Map *get_word_to_count_map_parallel(const char *data, size_t size, size_t thread_count,
+                                         size_t init_capacity, float load_factor) {
+    CountTask *tasks = malloc(thread_count * sizeof(CountTask));
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    if (tasks == NULL || threads == NULL) {
+        LOG_ERROR("Unable to allocate memory for word counting threads\n");
+        free(tasks);
+        free(threads);
+        return NULL;
+    }
+    size_t started_count = 0;
+    const char *chunk_begin = data;
+    for (size_t i = 0; i < thread_count; i++) {
+        size_t position = i + 1 == thread_count ? size : size / thread_count * (i + 1);
+        const char *chunk_end = find_chunk_end(data, size, position);
+        if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+        tasks[i] = (CountTask) {chunk_begin, chunk_end, init_capacity, load_factor, NULL};
+        chunk_begin = chunk_end;
+        if (pthread_create(&threads[i], NULL, count_words_task, &tasks[i]) != 0) {
+            LOG_ERROR("Unable to start word counting thread\n");
+            break;
+        }
+        started_count++;
+    }
+    for (size_t i = 0; i < started_count; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    HM172Map *word_to_count_map = NULL;
+    bool failed = started_count != thread_count;
+    for (size_t i = 0; i < started_count; i++) {
+        if (tasks[i].word_to_count_map == NULL) failed = true;
+        else if (word_to_count_map == NULL) word_to_count_map = tasks[i].word_to_count_map;
+        else if (failed) hm172_free(tasks[i].word_to_count_map);
+        else {
+            hm172_merge_and_free(word_to_count_map, tasks[i].word_to_count_map, add_counts);
+            if (hm172_log_on_error(word_to_count_map)) failed = true;
+        }
+    }
+    free(tasks);
+    if (failed) {
+        hm172_free(word_to_count_map);
+        return NULL;
     }
     return word_to_count_map;
 }
 
+HM172Map *get_word_to_count_map_from_source(WordSource *source, size_t init_capacity, float load_factor) {
+    if (source->data == NULL) return get_word_to_count_map(source->file, init_capacity, load_factor);
+    return get_word_to_count_map_parallel(source->data, source->size, source->thread_count, init_capacity, load_factor);
+}
+
 HM172Entry *get_most_common_word_entry(HM172Map *word_to_count_map) {
-    HM172EntryIterator *iterator = hm172_get_entry_iterator(word_to_count_map);
-    if (hm172_log_on_error(word_to_count_map)) return NULL;
-    HM172Entry *most_common_word_entry = NULL;
-    HM172Entry *cur_entry;
-    while ((cur_entry = hm172_next_entry(iterator)) != NULL)
-        if (most_common_word_entry == NULL ||
-                hm172_get_entry_value(cur_entry) > hm172_get_entry_value(most_common_word_entry))
-            most_common_word_entry = cur_entry;
-    hm172_free_entry_iterator(iterator);
-    if (most_common_word_entry == NULL) {
+    HM172Entry *most_common_word_entry;
+    if (hm172_top_k(word_to_count_map, 1, hm172_compare_entry_values, &most_common_word_entry) == 0) {
         LOG_ERROR("No words were found\n");
         return NULL;
     }
     return most_common_word_entry;
 }
 
-int run_experiment(FILE *input_file, FILE *output_file, size_t init_capacity, float load_factor) {
-    clock_t clock_before = clock();
+/*
+ * Returns wall clock time in seconds, which unlike clock() doesn't sum up the time of parallel threads
+ */
+double get_time_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+int run_experiment(WordSource *source, FILE *output_file, size_t init_capacity, float load_factor) {
+    double time_before = get_time_seconds();
     if (fprintf(output_file, "\nInitial capacity: %zu\n", init_capacity) < 0) {
         LOG_ERROR("Unable to print initial capacity\n");
         return -1;
     }
-    HM172Map *word_to_count_map = get_word_to_count_map(input_file, init_capacity, load_factor);
+    HM172Map *word_to_count_map = get_word_to_count_map_from_source(source, init_capacity, load_factor);
     if (word_to_count_map == NULL) return -1;
     HM172Entry *most_common_word_entry = get_most_common_word_entry(word_to_count_map);
     if (most_common_word_entry == NULL) {
@@ -112,51 +364,475 @@ int run_experiment(FILE *input_file, FILE *output_file, size_t init_capacity, fl
         return -1;
     }
     hm172_free(word_to_count_map);
-    clock_t clock_after = clock();
-    if (fprintf(output_file, "Time taken: %f seconds\n\n", ((double) (clock_after - clock_before)) / CLOCKS_PER_SEC) < 0) {
+    if (fprintf(output_file, "Time taken: %f seconds\n\n", get_time_seconds() - time_before) < 0) {
         LOG_ERROR("Unable to print execution time\n");
         return -1;
     }
     return 0;
 }
 
+/*
+ * Maps the whole file to memory, sets source data to NULL and logs error if the file can't be mapped
+ */
+void map_input_file(const char *path, WordSource *source) {
+    source->data = NULL;
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        LOG_ERROR("Unable to open input file \"%s\"\n", path);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    source->size = (size_t) file_stat.st_size;
+    if (source->size == 0) {
+        source->data = ""; // mmap can't map empty files
+        close(fd);
+        return;
+    }
+    void *data = mmap(NULL, source->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG_ERROR("Unable to map input file \"%s\" to memory\n", path);
+        return;
+    }
+    madvise(data, source->size, MADV_WILLNEED);
+    source->data = data;
+}
+
+void close_source(WordSource *source) {
+    if (source->file != NULL) fclose(source->file);
+    if (source->data != NULL && source->size != 0) munmap((void *) source->data, source->size);
+}
+
+/*
+ * Grows the array to hold at least required elements, doubling its capacity
+ * Returns -1 if memory can't be allocated, leaving the array unchanged
+ */
+int reserve_elements(void **array, size_t *capacity, size_t required, size_t element_size) {
+    if (required <= *capacity) return 0;
+    size_t new_capacity = *capacity < 16 ? 16 : *capacity;
+    while (new_capacity < required) new_capacity *= 2;
+    void *new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL) return -1;
+    *array = new_array;
+    *capacity = new_capacity;
+    return 0;
+}
+
+const char *get_trace_word(const WordTrace *trace, size_t index, size_t *length) {
+    *length = trace->word_offsets[index + 1] - trace->word_offsets[index];
+    return trace->word_data + trace->word_offsets[index];
+}
+
+void free_trace(WordTrace *trace) {
+    free(trace->word_data);
+    free(trace->word_offsets);
+    free(trace->word_indices);
+    for (size_t i = 0; i < HASH_COUNT; i++)
+        free(trace->hashes[i]);
+}
+
+/*
+ * Appends the word to the distinct words of the trace, the word index is the previous distinct word count
+ */
+int add_trace_word(WordTrace *trace, const char *word, size_t length, size_t *data_capacity, size_t *offset_capacity) {
+    size_t data_size = trace->word_offsets[trace->word_count];
+    if (reserve_elements((void **) &trace->word_data, data_capacity, data_size + length, sizeof(char)) != 0
+        || reserve_elements((void **) &trace->word_offsets, offset_capacity, trace->word_count + 2,
+                            sizeof(size_t)) != 0)
+        return -1;
+    memcpy(trace->word_data + data_size, word, length);
+    trace->word_offsets[++trace->word_count] = data_size + length;
+    return 0;
+}
+
+/*
+ * Tokenizes the data once into the trace, the distinct words are found with a map from the words to their indices
+ * Returns -1 and logs error if the trace can't be built
+ */
+int build_trace(const char *data, size_t size, WordTrace *trace) {
+    *trace = (WordTrace) {0};
+    size_t data_capacity = 0, offset_capacity = 0, index_capacity = 0;
+    WordTokenizer *tokenizer = malloc(sizeof(WordTokenizer));
+    HM172MapOptions options = {
+            .engine = ENGINE_OPEN_ADDRESSING, .capacity = 0, .load_factor = 0.875f,
+            .hash_function = hm172_polynomial_hash, .hash_n_function = hm172_mum_hash
+    };
+    HM172Map *word_to_index_map = hm172_new_map_with_options(&options);
+    int result = tokenizer == NULL || word_to_index_map == NULL
+                 || reserve_elements((void **) &trace->word_offsets, &offset_capacity, 1, sizeof(size_t)) != 0 ? -1 : 0;
+    if (result == 0) {
+        trace->word_offsets[0] = 0;
+        init_tokenizer(tokenizer);
+        feed_tokenizer(tokenizer, data, data + size, true);
+    }
+    const char *word;
+    size_t length;
+    while (result == 0 && next_word(tokenizer, &word, &length)) {
+        bool inserted;
+        HM172Value *index = hm172_get_or_put_n(word_to_index_map, word, length, (HM172Value) trace->word_count,
+                                               &inserted);
+        bool is_added = !inserted || (trace->word_count < INT_MAX
+                                      && add_trace_word(trace, word, length, &data_capacity, &offset_capacity) == 0);
+        if (index == NULL || !is_added
+            || reserve_elements((void **) &trace->word_indices, &index_capacity, trace->length + 1,
+                                sizeof(uint32_t)) != 0) {
+            result = -1;
+            break;
+        }
+        trace->word_indices[trace->length++] = (uint32_t) *index;
+    }
+    if (result != 0) {
+        LOG_ERROR("Unable to allocate memory for word trace\n");
+        free_trace(trace);
+    }
+    free(tokenizer);
+    hm172_free(word_to_index_map);
+    return result;
+}
+
+/*
+ * Computes the hashes of the distinct words by the hash function and measures hashing time of the whole trace,
+ * which replays don't include, since they take the computed hashes
+ * Returns -1 and logs error if memory for the hashes can't be allocated
+ */
+int hash_trace(WordTrace *trace, size_t hash_index) {
+    hash_n_function_t hash_n_function = HASH_N_FUNCTIONS[hash_index];
+    HM172Hash *hashes = malloc((trace->word_count > 0 ? trace->word_count : 1) * sizeof(HM172Hash));
+    if (hashes == NULL) {
+        LOG_ERROR("Unable to allocate memory for word hashes\n");
+        return -1;
+    }
+    size_t length;
+    for (size_t i = 0; i < trace->word_count; i++) {
+        const char *word = get_trace_word(trace, i, &length);
+        hashes[i] = hash_n_function(word, length, SWEEP_HASH_SEED);
+    }
+    HM172Hash combined_hash = 0;
+    double time_before = get_time_seconds();
+    for (size_t i = 0; i < trace->length; i++) {
+        const char *word = get_trace_word(trace, trace->word_indices[i], &length);
+        combined_hash ^= hash_n_function(word, length, SWEEP_HASH_SEED);
+    }
+    double seconds = get_time_seconds() - time_before;
+    hash_sink = combined_hash;
+    trace->hashes[hash_index] = hashes;
+    trace->hash_ns_per_word[hash_index] = trace->length > 0 ? seconds * 1e9 / (double) trace->length : 0;
+    return 0;
+}
+
+void count_allocation(MemoryCounter *counter, size_t size) {
+    counter->bytes += size;
+    if (counter->bytes > counter->peak_bytes) counter->peak_bytes = counter->bytes;
+}
+
+void *counting_alloc(void *context, size_t size) {
+    void *pointer = malloc(size);
+    if (pointer != NULL) count_allocation(context, size);
+    return pointer;
+}
+
+void *counting_zero_alloc(void *context, size_t size) {
+    void *pointer = calloc(1, size);
+    if (pointer != NULL) count_allocation(context, size);
+    return pointer;
+}
+
+void counting_free(void *context, void *pointer, size_t size) {
+    ((MemoryCounter *) context)->bytes -= size;
+    free(pointer);
+}
+
+/*
+ * Returns hm172_fprint_stats output, or NULL and logs error if it can't be printed
+ */
+char *get_stats_text(HM172Map *map) {
+    char *text = NULL;
+    size_t text_size;
+    FILE *stream = open_memstream(&text, &text_size);
+    if (stream == NULL) {
+        LOG_ERROR("Unable to allocate memory for map stats\n");
+        return NULL;
+    }
+    hm172_fprint_stats(map, stream);
+    if (fclose(stream) != 0 || hm172_log_on_error(map)) {
+        LOG_ERROR("Unable to print map stats\n");
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/*
+ * Counts the words of the trace with a new map of the configuration, each word is looked up with its computed hash
+ * Sets the config stats to NULL and logs error if the map can't be updated
+ */
+void replay_trace(const WordTrace *trace, SweepConfig *config) {
+    HM172Allocator allocator = {counting_alloc, counting_zero_alloc, counting_free, &config->memory};
+    HM172MapOptions options = config->map_options;
+    options.allocator = &allocator;
+    config->stats = NULL;
+    HM172Map *word_to_count_map = hm172_new_map_with_options(&options);
+    if (word_to_count_map == NULL) {
+        LOG_ERROR("Unable to allocate memory for word to count map\n");
+        return;
+    }
+    const HM172Hash *hashes = trace->hashes[config->hash_index];
+    double time_before = get_time_seconds();
+    for (size_t i = 0; i < trace->length; i++) {
+        size_t length;
+        uint32_t index = trace->word_indices[i];
+        const char *word = get_trace_word(trace, index, &length);
+        int *count_ptr = hm172_get_or_put_hashed(word_to_count_map, word, length, hashes[index], 0, NULL);
+        if (count_ptr == NULL) break;
+        (*count_ptr)++;
+    }
+    config->seconds = get_time_seconds() - time_before;
+    config->unique_word_count = hm172_size(word_to_count_map);
+    config->final_bytes = config->memory.bytes;
+    if (!hm172_log_on_error(word_to_count_map)) config->stats = get_stats_text(word_to_count_map);
+    hm172_free(word_to_count_map);
+}
+
+/*
+ * Replays the trace for the configurations taken from the queue until it's empty
+ */
+void *sweep_task(void *queue_ptr) {
+    SweepQueue *queue = queue_ptr;
+    while (true) {
+        pthread_mutex_lock(&queue->mutex);
+        size_t index = queue->next_config++;
+        pthread_mutex_unlock(&queue->mutex);
+        if (index >= queue->config_count) return NULL;
+        replay_trace(queue->trace, &queue->configs[index]);
+    }
+}
+
+/*
+ * Replays the configurations in job_count threads, one of which is the calling thread
+ */
+void run_sweep_jobs(SweepQueue *queue, size_t job_count) {
+    pthread_t *threads = job_count > 1 ? malloc((job_count - 1) * sizeof(pthread_t)) : NULL;
+    size_t started_count = 0;
+    if (job_count > 1 && threads == NULL)
+        LOG_ERROR("Unable to allocate memory for sweep threads, running the sweep in one thread\n");
+    for (size_t i = 0; threads != NULL && i + 1 < job_count; i++) {
+        if (pthread_create(&threads[i], NULL, sweep_task, queue) != 0) {
+            LOG_ERROR("Unable to start sweep thread\n");
+            break;
+        }
+        started_count++;
+    }
+    sweep_task(queue);
+    for (size_t i = 0; i < started_count; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+/*
+ * Prints the value of the line of the stats that starts with the name, or nothing if there's no such line
+ */
+int fprint_stats_value(FILE *file, const char *stats, const char *name) {
+    size_t name_length = strlen(name);
+    for (const char *line = stats; *line != '\0'; line += strcspn(line, "\n") + (line[strcspn(line, "\n")] != '\0')) {
+        if (strncmp(line, name, name_length) != 0 || strncmp(line + name_length, ": ", 2) != 0) continue;
+        const char *value = line + name_length + 2;
+        return fprintf(file, ",%.*s", (int) strcspn(value, "\n"), value);
+    }
+    return fprintf(file, ",");
+}
+
+int fprint_sweep_result(FILE *csv_file, const WordTrace *trace, const SweepConfig *config) {
+    const HM172MapOptions *options = &config->map_options;
+    if (fprintf(csv_file, "%s,%s,%g,%zu,%zu,%zu,%f,%.0f,%.2f,%zu,%.2f",
+                ENGINE_NAMES[options->engine], HASH_NAMES[config->hash_index], options->load_factor,
+                options->capacity, trace->length, config->unique_word_count, config->seconds,
+                config->seconds > 0 ? (double) trace->length / config->seconds : 0,
+                trace->hash_ns_per_word[config->hash_index], config->memory.peak_bytes,
+                config->unique_word_count > 0
+                ? (double) config->final_bytes / (double) config->unique_word_count : 0) < 0)
+        return -1;
+    for (size_t i = 0; i < sizeof(STATS_NAMES) / sizeof(STATS_NAMES[0]); i++)
+        if (fprint_stats_value(csv_file, config->stats, STATS_NAMES[i]) < 0) return -1;
+    return fprintf(csv_file, "\n") < 0 ? -1 : 0;
+}
+
+/*
+ * Replays the trace for every combination of the engines, hashes, load factors and capacities, in the order
+ * of the combinations, and prints a CSV line for each one that has succeeded
+ * Returns -1 and logs error if memory can't be allocated, or if any of the replays or prints fails
+ */
+int sweep(WordTrace *trace, SizeList *engines, SizeList *hashes, FloatList *load_factors, SizeList *capacities,
+          size_t job_count, FILE *csv_file) {
+    for (size_t i = 0; i < hashes->count; i++)
+        if (trace->hashes[hashes->values[i]] == NULL && hash_trace(trace, hashes->values[i]) != 0) return -1;
+    SweepQueue queue = {
+            .trace = trace,
+            .config_count = engines->count * hashes->count * load_factors->count * capacities->count
+    };
+    queue.configs = calloc(queue.config_count, sizeof(SweepConfig));
+    if (queue.configs == NULL || pthread_mutex_init(&queue.mutex, NULL) != 0) {
+        LOG_ERROR("Unable to allocate memory for sweep configurations\n");
+        free(queue.configs);
+        return -1;
+    }
+    SweepConfig *config = queue.configs;
+    for (size_t engine = 0; engine < engines->count; engine++)
+        for (size_t hash = 0; hash < hashes->count; hash++)
+            for (size_t load_factor = 0; load_factor < load_factors->count; load_factor++)
+                for (size_t capacity = 0; capacity < capacities->count; capacity++)
+                    *config++ = (SweepConfig) {
+                            .map_options = {
+                                    .engine = (HM172Engine) engines->values[engine],
+                                    .capacity = capacities->values[capacity],
+                                    .load_factor = load_factors->values[load_factor],
+                                    .hash_function = hm172_polynomial_hash,
+                                    .hash_n_function = HASH_N_FUNCTIONS[hashes->values[hash]],
+                                    .hash_seed = SWEEP_HASH_SEED
+                            },
+                            .hash_index = hashes->values[hash]
+                    };
+    run_sweep_jobs(&queue, job_count);
+    pthread_mutex_destroy(&queue.mutex);
+    int result = 0;
+    if (fprintf(csv_file, "engine,hash,load_factor,capacity,words,unique_words,seconds,words_per_second,"
+                          "hash_ns_per_word,peak_bytes,bytes_per_unique_word,%s\n", STATS_COLUMNS) < 0)
+        result = -1;
+    for (size_t i = 0; i < queue.config_count; i++) {
+        if (queue.configs[i].stats == NULL) result = -1;
+        else if (result == 0 && fprint_sweep_result(csv_file, trace, &queue.configs[i]) != 0) {
+            LOG_ERROR("Unable to print results to CSV file\n");
+            result = -1;
+        }
+        free(queue.configs[i].stats);
+    }
+    free(queue.configs);
+    return result;
+}
+
+/*
+ * Sweep mode: word_counter --sweep [options] <input file> <CSV file> <load factors> <capacities...>
+ * argv[0] is the --sweep option
+ */
+int run_sweep(int argc, char *argv[]) {
+    SizeList engines = {1, {ENGINE_CHAINED}};
+    SizeList hashes = {1, {0}};
+    size_t job_count = 1;
+    while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+        int result;
+        if (strcmp(argv[1], JOB_COUNT_OPTION) == 0) {
+            result = str_to_size_t(argv[2], &job_count, "job count");
+            if (result == 0 && job_count == 0) {
+                LOG_ERROR("Invalid job count. It must be positive\n");
+                result = -1;
+            }
+        } else if (strcmp(argv[1], ENGINES_OPTION) == 0) {
+            result = parse_name_list(argv[2], ENGINE_NAMES, sizeof(ENGINE_NAMES) / sizeof(ENGINE_NAMES[0]), &engines,
+                                     "engines");
+        } else if (strcmp(argv[1], HASHES_OPTION) == 0) {
+            result = parse_name_list(argv[2], HASH_NAMES, HASH_COUNT, &hashes, "hashes");
+        } else {
+            LOG_ERROR("Unknown option \"%s\"\n", argv[1]);
+            result = -1;
+        }
+        if (result != 0) return -1;
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < MIN_ARG_COUNT) {
+        LOG_ERROR("Invalid number of command line arguments. Expected at least %d arg(s), but found %d arg(s)\n"
+                  "Usage: word_counter %s [%s <job count>] [%s chained,open-addressing,dense]\n"
+                  "                           [%s polynomial,mum,stripe] <input file> <CSV file> <load factors>"
+                  " <capacities...>\n",
+                  MIN_ARG_COUNT - 1, argc - 1, SWEEP_OPTION, JOB_COUNT_OPTION, ENGINES_OPTION, HASHES_OPTION);
+        return -1;
+    }
+    FloatList load_factors;
+    SizeList capacities = {0};
+    if (parse_float_list(argv[LOAD_FACTOR_ARG_INDEX], &load_factors, "load factors") != 0) return -1;
+    for (int i = FIRST_CAPACITY_ARG_INDEX; i < argc; i++) {
+        if (capacities.count == MAX_LIST_LENGTH) {
+            LOG_ERROR("Invalid capacities. At most %d values are allowed\n", MAX_LIST_LENGTH);
+            return -1;
+        }
+        if (str_to_size_t(argv[i], &capacities.values[capacities.count++], "capacity") != 0) return -1;
+    }
+    WordSource source = {NULL, NULL, 0, 0};
+    map_input_file(argv[INPUT_FILE_ARG_INDEX], &source);
+    if (source.data == NULL) return -1;
+    WordTrace trace;
+    int result = build_trace(source.data, source.size, &trace);
+    close_source(&source);
+    if (result != 0) return -1;
+    FILE *csv_file = fopen(argv[OUTPUT_FILE_ARG_INDEX], "w");
+    if (csv_file == NULL) {
+        LOG_ERROR("Unable to open CSV file \"%s\"\n", argv[OUTPUT_FILE_ARG_INDEX]);
+        free_trace(&trace);
+        return -1;
+    }
+    result = sweep(&trace, &engines, &hashes, &load_factors, &capacities, job_count, csv_file);
+    free_trace(&trace);
+    if (fclose(csv_file) != 0) {
+        LOG_ERROR("Unable to close CSV file\n");
+        return -1;
+    }
+    return result;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], SWEEP_OPTION) == 0) return run_sweep(argc - 1, argv + 1);
+    WordSource source = {NULL, NULL, 0, 0};
+    if (argc > 2 && strcmp(argv[1], THREAD_COUNT_OPTION) == 0) {
+        if (str_to_size_t(argv[2], &source.thread_count, "thread count") != 0) return -1;
+        if (source.thread_count == 0) {
+            LOG_ERROR("Invalid thread count. It must be positive\n");
+            return -1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
     if (argc < MIN_ARG_COUNT) {
         LOG_ERROR("Invalid number of command line arguments. Expected at least %d arg(s), but found %d arg(s)\n"
-                  "Usage: word_counter <input file> <output file> <load factor> <capacities...>\n",
-                  MIN_ARG_COUNT - 1, argc - 1);
+                  "Usage: word_counter [%s <thread count>] <input file> <output file> <load factor> <capacities...>\n"
+                  "       word_counter %s [options] <input file> <CSV file> <load factors> <capacities...>\n",
+                  MIN_ARG_COUNT - 1, argc - 1, THREAD_COUNT_OPTION, SWEEP_OPTION);
         return -1;
     }
     float load_factor;
     if (str_to_float(argv[LOAD_FACTOR_ARG_INDEX], &load_factor, "load factor"))
         return -1;
-    FILE *input_file = fopen(argv[INPUT_FILE_ARG_INDEX], "r");
-    if (input_file == NULL) {
-        LOG_ERROR("Unable to open input file \"%s\"\n", argv[INPUT_FILE_ARG_INDEX]);
-        return -1;
+    if (source.thread_count == 0) {
+        source.file = fopen(argv[INPUT_FILE_ARG_INDEX], "r");
+        if (source.file == NULL) {
+            LOG_ERROR("Unable to open input file \"%s\"\n", argv[INPUT_FILE_ARG_INDEX]);
+            return -1;
+        }
+    } else {
+        map_input_file(argv[INPUT_FILE_ARG_INDEX], &source);
+        if (source.data == NULL) return -1;
     }
     FILE *output_file = fopen(argv[OUTPUT_FILE_ARG_INDEX], "w");
-    if (input_file == NULL) {
+    if (output_file == NULL) {
         LOG_ERROR("Unable to open output file \"%s\"\n", argv[OUTPUT_FILE_ARG_INDEX]);
-        fclose(input_file);
+        close_source(&source);
         return -1;
     }
     size_t capacity;
     for (int i = FIRST_CAPACITY_ARG_INDEX; i < argc; i++) {
         if (str_to_size_t(argv[i], &capacity, "capacity") != 0
-            || run_experiment(input_file, output_file, capacity, load_factor) != 0) {
-            fclose(input_file);
+            || run_experiment(&source, output_file, capacity, load_factor) != 0) {
+            close_source(&source);
             fclose(output_file);
             return -1;
         }
-        if(fseek(input_file, 0, SEEK_SET) != 0) {
+        if(source.file != NULL && fseek(source.file, 0, SEEK_SET) != 0) {
             LOG_ERROR("Unable to rewind input file \"%s\"\n", argv[INPUT_FILE_ARG_INDEX]);
-            fclose(input_file);
+            close_source(&source);
             fclose(output_file);
             return -1;
         }
     }
-    fclose(input_file);
+    close_source(&source);
     if(fclose(output_file) != 0) {
         LOG_ERROR("Unable to close output file\n");
         return -1;
@@ -0,0 +1,23 @@
+#ifndef HASHMAP_172_FROZEN_H
+#define HASHMAP_172_FROZEN_H
+
+#include "map.h"
+
+/*
+ * Rebuilds the map as a read-only table for maps that are built once and then only read: the entries are placed
+ * by a minimal perfect hash function over the current keys, so they fill an array of exactly size entries
+ * followed by the keys that aren't inline, and a lookup mixes the map hash of the key with a seed, reads a pilot
+ * and then a single entry, with one key comparison, so batched gets prefetch them as for the other engines
+ * Only the keys whose map hash equals the one of another key take a second such lookup by a seeded 64 bit hash
+ * of the key
+ * Building takes O(size * log(size)) expected time and about 40 bytes per entry of temporary memory
+ * hm172_get, the batched gets and iteration work as usual, and values can be changed through the pointers
+ * returned by hm172_get; the first put of a new key, removal of a present key or clear copies the entries
+ * to a normal table of the map engine, invalidating the entry, key and value pointers obtained before it
+ * Freezing also invalidates them, and frees the previous table, the key copies and the arena of the map
+ * Freezing a frozen map does nothing
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY and the map is unchanged
+ */
+void hm172_freeze(HM172Map *map);
+
+#endif // HASHMAP_172_FROZEN_H
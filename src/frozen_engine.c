@@ -0,0 +1,480 @@
+#include <malloc.h>
+#include <memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "map_engine.h"
+#include "hash_functions.h"
+#include "frozen.h"
+
+/*
+ * Read-only engine placing the entries by a minimal perfect hash function in the style of PTHash:
+ * the map hashes of the keys are mixed with a seed to 64 bit fingerprints, which are split into buckets
+ * of AVERAGE_BUCKET_SIZE on average, and each bucket gets the smallest pilot that sends the fingerprints of its keys
+ * to slots no other key took, so the entries fill their slots exactly and the slot of a key is found from its map hash
+ * and the pilot of its bucket, with no hashing of the key itself
+ * The map hashes of different keys can be equal, e.g. 32 bit ones of large maps or adversarial ones, so one entry
+ * of each hash is placed by the hash, and the rest of the entries sharing the hash are placed by a second function
+ * over fingerprints of their keys, which only the lookups finding another key in the slot of their hash reach
+ * Any modification promotes the map to the engine selected by its options
+ */
+
+#define AVERAGE_BUCKET_SIZE 4
+
+static const uint64_t PILOT_MULTIPLIER = UINT64_C(0x9E3779B97F4A7C15);
+
+/*
+ * Minimal perfect hash function of size fingerprints, with the pilots of its buckets
+ */
+typedef struct {
+    size_t size;
+    size_t bucket_count;
+    uint32_t *pilots;
+    uint64_t seed; // fingerprint seed
+} PerfectHash;
+
+typedef struct {
+    size_t size;
+    HM172Entry *entries; // size of them, the ones placed by hash and then the ones placed by key, or one if size is 0
+    char *keys; // '\0'-terminated keys that aren't inline, in the entry order
+    PerfectHash by_hash; // places an entry of each map hash
+    PerfectHash by_key; // places the entries sharing their map hash with the one placed by hash
+    size_t key_bytes;
+    const engine_t *target_engine;
+} FrozenTable;
+
+/*
+ * Temporary arrays of a build, the fingerprints and the entries are sorted by bucket
+ */
+typedef struct {
+    HM172Entry **inputs; // the entries placed by hash, followed by the entries placed by key
+    uint64_t *fingerprints;
+    HM172Entry **entries;
+    size_t *slots;
+    size_t *bucket_starts; // bucket_count + 1 entry indices
+    size_t *buckets; // sorted by size, largest first
+    bool *taken_slots;
+} Build;
+
+static FrozenTable *get_table(HM172Map *map) {
+    return (FrozenTable *) map->table;
+}
+
+/*
+ * Finalizer of MurmurHash3, every input bit affects every output bit
+ */
+static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33u;
+    hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    hash ^= hash >> 33u;
+    hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    return hash ^ (hash >> 33u);
+}
+
+/*
+ * The mix is a bijection, so different hashes always have different fingerprints
+ */
+static uint64_t get_hash_fingerprint(const PerfectHash *function, HM172Hash hash) {
+    return mix((uint64_t) hash ^ function->seed);
+}
+
+static uint64_t get_key_fingerprint(const PerfectHash *function, HM172ConstKey key, size_t key_length) {
+    return hm172_mum_hash_64(key, key_length, function->seed);
+}
+
+static uint64_t get_entry_fingerprint(const PerfectHash *function, const HM172Entry *entry, bool by_key) {
+    return by_key ? get_key_fingerprint(function, hm172_entry_key(entry), entry->key_length)
+                  : get_hash_fingerprint(function, entry->hash);
+}
+
+/*
+ * 60% of the keys go to the first 30% of the buckets, the rest to the other 70%, as in PTHash:
+ * the pilots of the large buckets are found while most of the slots are free, which leaves smaller buckets
+ * to place into the last free slots
+ */
+static size_t get_bucket(const PerfectHash *function, uint64_t fingerprint) {
+    size_t dense_bucket_count = function->bucket_count * 3 / 10 + 1;
+    if (fingerprint < UINT64_MAX / 10 * 6) return (fingerprint >> 32u) % dense_bucket_count;
+    return dense_bucket_count + (fingerprint >> 32u) % (function->bucket_count - dense_bucket_count);
+}
+
+static size_t get_slot(uint64_t fingerprint, uint64_t pilot, size_t size) {
+    return mix(fingerprint ^ pilot * PILOT_MULTIPLIER) % size;
+}
+
+static size_t find_slot(const PerfectHash *function, uint64_t fingerprint) {
+    return get_slot(fingerprint, function->pilots[get_bucket(function, fingerprint)], function->size);
+}
+
+static size_t get_entry_count(const FrozenTable *table) {
+    return table->size == 0 ? 1 : table->size;
+}
+
+static size_t get_key_pool_size(const FrozenTable *table) {
+    return table->key_bytes == 0 ? 1 : table->key_bytes;
+}
+
+static void free_table(HM172Map *map, FrozenTable *table) {
+    hm172_deallocate(map, table->entries, get_entry_count(table) * sizeof(HM172Entry));
+    hm172_deallocate(map, table->keys, get_key_pool_size(table));
+    hm172_deallocate(map, table->by_hash.pilots, table->by_hash.bucket_count * sizeof(uint32_t));
+    hm172_deallocate(map, table->by_key.pilots, table->by_key.bucket_count * sizeof(uint32_t));
+    hm172_deallocate(map, table, sizeof(FrozenTable));
+}
+
+static void free_build(Build *build) {
+    free(build->inputs);
+    free(build->fingerprints);
+    free(build->entries);
+    free(build->slots);
+    free(build->bucket_starts);
+    free(build->buckets);
+    free(build->taken_slots);
+}
+
+static int compare_entry_hashes(const void *entry, const void *other_entry) {
+    HM172Hash hash = (*(HM172Entry *const *) entry)->hash, other_hash = (*(HM172Entry *const *) other_entry)->hash;
+    return (hash > other_hash) - (hash < other_hash);
+}
+
+/*
+ * Sets the inputs to the entries of the map, the first one of each hash followed by the rest,
+ * returns the number of the first ones
+ */
+static size_t split_by_hash(HM172Map *map, Build *build) {
+    size_t size = 0;
+    HM172EntryIterator iterator;
+    hm172_init_entry_iterator(&iterator, map);
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL;) build->entries[size++] = entry;
+    qsort(build->entries, size, sizeof(HM172Entry *), compare_entry_hashes);
+    size_t first_count = 0, rest_end = size;
+    for (size_t i = 0; i < size; i++) {
+        if (i == 0 || build->entries[i]->hash != build->entries[i - 1]->hash)
+            build->inputs[first_count++] = build->entries[i];
+        else build->inputs[--rest_end] = build->entries[i];
+    }
+    return first_count;
+}
+
+/*
+ * Sorts the fingerprints and the inputs by bucket counting the bucket sizes in bucket_starts[i + 1],
+ * then sorts the buckets by size the same way
+ * Returns false if two keys of a bucket have the same fingerprint, so that no pilot can separate them
+ */
+static bool sort_by_bucket(const PerfectHash *function, HM172Entry **inputs, bool by_key, Build *build) {
+    size_t bucket_count = function->bucket_count;
+    memset(build->bucket_starts, 0, (bucket_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < function->size; i++)
+        build->bucket_starts[get_bucket(function, get_entry_fingerprint(function, inputs[i], by_key)) + 1]++;
+    size_t max_bucket_size = 0;
+    for (size_t i = 1; i <= bucket_count; i++) {
+        if (build->bucket_starts[i] > max_bucket_size) max_bucket_size = build->bucket_starts[i];
+        build->bucket_starts[i] += build->bucket_starts[i - 1];
+    }
+    // bucket_starts[i] is the next free index of bucket i, which ends up as the start of bucket i + 1
+    for (size_t i = 0; i < function->size; i++) {
+        uint64_t fingerprint = get_entry_fingerprint(function, inputs[i], by_key);
+        size_t index = build->bucket_starts[get_bucket(function, fingerprint)]++;
+        build->fingerprints[index] = fingerprint;
+        build->entries[index] = inputs[i];
+    }
+    memmove(build->bucket_starts + 1, build->bucket_starts, bucket_count * sizeof(size_t));
+    build->bucket_starts[0] = 0;
+    for (size_t bucket = 0; by_key && bucket < bucket_count; bucket++)
+        for (size_t i = build->bucket_starts[bucket]; i < build->bucket_starts[bucket + 1]; i++)
+            for (size_t j = build->bucket_starts[bucket]; j < i; j++)
+                if (build->fingerprints[i] == build->fingerprints[j]) return false;
+    // the bucket size counts are kept in the slots, which aren't used yet, as the size index ranges
+    size_t *size_starts = build->slots;
+    memset(size_starts, 0, (max_bucket_size + 2) * sizeof(size_t));
+    for (size_t bucket = 0; bucket < bucket_count; bucket++)
+        size_starts[max_bucket_size - (build->bucket_starts[bucket + 1] - build->bucket_starts[bucket]) + 1]++;
+    for (size_t i = 1; i <= max_bucket_size + 1; i++) size_starts[i] += size_starts[i - 1];
+    for (size_t bucket = 0; bucket < bucket_count; bucket++)
+        build->buckets[size_starts[max_bucket_size - (build->bucket_starts[bucket + 1] - build->bucket_starts[bucket])]++]
+                = bucket;
+    return true;
+}
+
+/*
+ * Finds the pilots of the buckets, largest first, as they are the hardest to place while the most slots are free
+ * Returns false if a bucket can't be placed with any pilot
+ */
+static bool find_pilots(PerfectHash *function, Build *build) {
+    memset(build->taken_slots, 0, function->size * sizeof(bool));
+    for (size_t i = 0; i < function->bucket_count; i++) {
+        size_t bucket = build->buckets[i];
+        size_t start = build->bucket_starts[bucket], end = build->bucket_starts[bucket + 1];
+        if (start == end) break; // the rest of the buckets are empty
+        uint64_t pilot = 0;
+        for (;; pilot++) {
+            if (pilot > UINT32_MAX) return false;
+            size_t placed = start;
+            for (; placed < end; placed++) {
+                size_t slot = get_slot(build->fingerprints[placed], pilot, function->size);
+                if (build->taken_slots[slot]) break;
+                build->taken_slots[slot] = true;
+                build->slots[placed] = slot;
+            }
+            if (placed == end) break;
+            while (placed > start) build->taken_slots[build->slots[--placed]] = false;
+        }
+        function->pilots[bucket] = (uint32_t) pilot;
+    }
+    return true;
+}
+
+/*
+ * Builds the function of the inputs and copies them to their slots of the entries, a new seed is drawn
+ * while the pilots can't be found for a seed, which takes more than one seed only if two key fingerprints
+ * of a bucket collide
+ */
+static void place_entries(PerfectHash *function, HM172Entry **inputs, bool by_key, Build *build, HM172Entry *entries) {
+    if (function->size == 0) return;
+    do function->seed = hm172_random_seed();
+    while (!sort_by_bucket(function, inputs, by_key, build) || !find_pilots(function, build));
+    for (size_t i = 0; i < function->size; i++) entries[build->slots[i]] = *build->entries[i];
+}
+
+/*
+ * Copies the keys that aren't inline to the key pool in the entry order
+ */
+static void fill_key_pool(FrozenTable *table) {
+    char *key = table->keys;
+    for (size_t i = 0; i < table->size; i++) {
+        HM172Entry *entry = table->entries + i;
+        if (hm172_is_key_inline(entry->key_length)) continue;
+        memcpy(key, entry->key, entry->key_length + 1);
+        entry->key = key;
+        key += entry->key_length + 1;
+    }
+}
+
+/*
+ * Builds the table from the entries of the map
+ */
+static FrozenTable *build_table(HM172Map *map, const engine_t *target_engine) {
+    size_t size = map->size;
+    FrozenTable *table = hm172_allocate_zeroed(map, sizeof(FrozenTable));
+    Build build = {0};
+    if (table == NULL) return NULL;
+    table->size = size;
+    size_t allocated_size = get_entry_count(table);
+    table->target_engine = target_engine;
+    HM172EntryIterator iterator;
+    hm172_init_entry_iterator(&iterator, map);
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL;)
+        if (!hm172_is_key_inline(entry->key_length)) table->key_bytes += entry->key_length + 1;
+    table->entries = hm172_allocate_zeroed(map, allocated_size * sizeof(HM172Entry));
+    table->keys = hm172_allocate(map, get_key_pool_size(table));
+    // the temporary arrays aren't kept by the map, so they aren't allocated with its allocator
+    build.inputs = malloc(allocated_size * sizeof(HM172Entry *));
+    build.fingerprints = malloc(allocated_size * sizeof(uint64_t));
+    build.entries = malloc(allocated_size * sizeof(HM172Entry *));
+    // the slots also hold the bucket size ranges, of which there are at most size + 2
+    build.slots = malloc((size + 2) * sizeof(size_t));
+    build.bucket_starts = malloc((size / AVERAGE_BUCKET_SIZE + 3) * sizeof(size_t));
+    build.buckets = malloc((size / AVERAGE_BUCKET_SIZE + 2) * sizeof(size_t));
+    build.taken_slots = malloc(allocated_size * sizeof(bool));
+    if (table->entries != NULL && build.inputs != NULL && build.entries != NULL) {
+        table->by_hash.size = split_by_hash(map, &build);
+        table->by_key.size = size - table->by_hash.size;
+    }
+    table->by_hash.bucket_count = table->by_hash.size / AVERAGE_BUCKET_SIZE + 2;
+    table->by_key.bucket_count = table->by_key.size / AVERAGE_BUCKET_SIZE + 2;
+    table->by_hash.pilots = hm172_allocate_zeroed(map, table->by_hash.bucket_count * sizeof(uint32_t));
+    table->by_key.pilots = hm172_allocate_zeroed(map, table->by_key.bucket_count * sizeof(uint32_t));
+    if (table->entries == NULL || table->keys == NULL || table->by_hash.pilots == NULL || table->by_key.pilots == NULL
+        || build.inputs == NULL || build.fingerprints == NULL || build.entries == NULL || build.slots == NULL
+        || build.bucket_starts == NULL || build.buckets == NULL || build.taken_slots == NULL) {
+        free_build(&build);
+        free_table(map, table);
+        return NULL;
+    }
+    place_entries(&table->by_hash, build.inputs, false, &build, table->entries);
+    place_entries(&table->by_key, build.inputs + table->by_hash.size, true, &build,
+                  table->entries + table->by_hash.size);
+    fill_key_pool(table);
+    free_build(&build);
+    return table;
+}
+
+static bool init(HM172Map *map, size_t capacity) {
+    (void) map;
+    (void) capacity;
+    return false; // frozen tables are only created by hm172_freeze
+}
+
+static void destroy(HM172Map *map) {
+    free_table(map, get_table(map));
+}
+
+/*
+ * The promoted table already has the capacity fitting the entries, and the new capacity may be invalid for its engine
+ */
+static void start_resize(HM172Map *map, size_t new_capacity) {
+    (void) new_capacity;
+    hm172_promote(map, get_table(map)->target_engine, true);
+}
+
+static void migrate(HM172Map *map, size_t bucket_count) {
+    (void) map;
+    (void) bucket_count;
+}
+
+/*
+ * Returns the entry with the key or NULL, setting *probe_count to the number of compared entries:
+ * one, or two for the keys whose hash is shared by another key
+ */
+static HM172Entry *find_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                              size_t *probe_count) {
+    *probe_count = 0;
+    if (map->size == 0) return NULL;
+    FrozenTable *table = get_table(map);
+    HM172Entry *entry = table->entries + find_slot(&table->by_hash, get_hash_fingerprint(&table->by_hash, hash));
+    *probe_count = 1;
+    if (entry->hash != hash) return NULL;
+    if (hm172_entry_has_key(entry, key, key_length)) return entry;
+    if (table->by_key.size == 0) return NULL;
+    entry = table->entries + table->by_hash.size
+            + find_slot(&table->by_key, get_key_fingerprint(&table->by_key, key, key_length));
+    *probe_count = 2;
+    return entry->hash == hash && hm172_entry_has_key(entry, key, key_length) ? entry : NULL;
+}
+
+static HM172Entry *find(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash) {
+    size_t probe_count;
+    HM172Entry *found = find_entry(map, key, key_length, hash, &probe_count);
+    hm172_record_lookup(map, probe_count, found != NULL);
+    return found;
+}
+
+/*
+ * Stages: the pilot, the entry placed by the hash, its key if it isn't inline
+ */
+static void prefetch(HM172Map *map, HM172Hash hash, unsigned stage) {
+    FrozenTable *table = get_table(map);
+    if (map->size == 0) return;
+    uint64_t fingerprint = get_hash_fingerprint(&table->by_hash, hash);
+    const uint32_t *pilot = table->by_hash.pilots + get_bucket(&table->by_hash, fingerprint);
+    if (stage == 0) {
+        PREFETCH(pilot);
+        return;
+    }
+    HM172Entry *entry = table->entries + get_slot(fingerprint, *pilot, table->by_hash.size);
+    if (stage == 1) PREFETCH(entry);
+    else if (!hm172_is_key_inline(entry->key_length)) PREFETCH(entry->key);
+}
+
+/*
+ * Only inserting a new key promotes the map, so that the pointers to the frozen entries stay valid until
+ * a modification
+ */
+static HM172Entry *find_or_insert(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                  bool *inserted) {
+    size_t probe_count;
+    HM172Entry *found = find_entry(map, key, key_length, hash, &probe_count);
+    if (found != NULL) {
+        hm172_record_lookup(map, probe_count, true);
+        *inserted = false;
+        return found;
+    }
+    if (!hm172_promote(map, get_table(map)->target_engine, true)) return NULL;
+    return map->engine->find_or_insert(map, key, key_length, hash, inserted);
+}
+
+static void undo_insert(HM172Map *map, HM172Entry *entry) {
+    (void) map;
+    (void) entry;
+}
+
+/*
+ * Only removing a present key promotes the map
+ */
+static bool remove_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, HM172Entry *removed) {
+    size_t probe_count;
+    if (find_entry(map, key, key_length, hash, &probe_count) == NULL) return false;
+    if (!hm172_promote(map, get_table(map)->target_engine, true)) return false;
+    return map->engine->remove_entry(map, key, key_length, hash, removed);
+}
+
+/*
+ * The keys belong to the table, so there's nothing to free
+ */
+static void clear(HM172Map *map, void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    (void) free_key;
+    hm172_promote(map, get_table(map)->target_engine, false);
+}
+
+/*
+ * Iteration positions are slots, all of which hold entries
+ */
+static size_t get_iteration_length(HM172Map *map) {
+    return map->size;
+}
+
+static void start_iteration(HM172EntryIterator *iterator) {
+    (void) iterator;
+}
+
+static HM172Entry *next_entry(HM172EntryIterator *iterator) {
+    if (iterator->next_index >= iterator->end_index) return NULL;
+    return get_table(iterator->map)->entries + iterator->next_index++;
+}
+
+static int fprint_stats(HM172Map *map, FILE *stream) {
+    FrozenTable *table = get_table(map);
+    uint32_t max_pilot = 0;
+    for (size_t i = 0; i < table->by_hash.bucket_count; i++)
+        if (table->by_hash.pilots[i] > max_pilot) max_pilot = table->by_hash.pilots[i];
+    for (size_t i = 0; i < table->by_key.bucket_count; i++)
+        if (table->by_key.pilots[i] > max_pilot) max_pilot = table->by_key.pilots[i];
+    return fprintf(stream, "frozen bucket count: %zu\n"
+                           "entries placed by key: %zu\n"
+                           "max pilot: %" PRIu32 "\n",
+                   table->by_hash.bucket_count + table->by_key.bucket_count, table->by_key.size, max_pilot);
+}
+
+/*
+ * The entries are counted as nodes, as their number is the size rather than the capacity, the pilots aren't counted
+ */
+const engine_t hm172_frozen_engine = {
+        init, destroy, start_resize, migrate, find, prefetch, find_or_insert, undo_insert, remove_entry, NULL, clear,
+        get_iteration_length, start_iteration, next_entry, fprint_stats,
+        1, 0, sizeof(HM172Entry), -1
+};
+
+void hm172_freeze(HM172Map *map) {
+    if (map->engine == &hm172_frozen_engine) return;
+    const engine_t *target_engine = map->engine == &hm172_mapped_engine ? hm172_get_mapped_target_engine(map)
+                                                                        : map->engine;
+    FrozenTable *table = build_table(map, target_engine);
+    if (table == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "frozen table"};
+        return;
+    }
+    size_t size = map->size;
+    if (map->engine == &hm172_mapped_engine) {
+        map->engine->destroy(map); // the keys belong to the file
+    } else {
+        hm172_clear(map);
+        map->engine->destroy(map);
+        if (map->uses_arena) {
+            hm172_arena_free(&map->arena);
+            hm172_arena_init(&map->arena, &map->allocator);
+        }
+    }
+    map->modification_count++;
+    map->engine = &hm172_frozen_engine;
+    map->table = table;
+    map->old_table = NULL;
+    map->capacity = 1;
+    while (map->capacity < size) map->capacity <<= 1u;
+    map->size = size;
+    map->deleted_count = 0;
+    map->threshold = -1; // the frozen table never grows, it's promoted on the first put
+    map->shrink_threshold = -1;
+#ifdef HM172_STATS
+    map->counters.key_bytes = table->key_bytes;
+#endif
+}
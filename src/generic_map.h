@@ -0,0 +1,239 @@
+#ifndef HASHMAP_172_GENERIC_MAP_H
+#define HASHMAP_172_GENERIC_MAP_H
+
+/*
+ * Code generator of maps specialized for the key and value types, for the types HM172Map can't hold directly
+ * The maps are open addressing tables probed a group of control bytes at a time, like ENGINE_OPEN_ADDRESSING,
+ * with the keys and values stored inline in the slots and all the functions defined static inline,
+ * so the hash and equality functions are inlined into the probes
+ * Entries move on resize, so all entry and value pointers become invalid after each put and removal
+ *
+ * HM172_DEFINE_MAP(name, KeyT, ValueT, hash_function, equals_function);
+ * defines the types name_t and name_entry_t and the functions below for keys that are stored as they are, where
+ *  - hash_function: uint64_t (KeyT key), the hash isn't stored, so it is recomputed for each entry on resize
+ *  - equals_function: bool (KeyT key, KeyT other_key)
+ * HM172_DEFINE_MAP_WITH_KEY_COPY(name, KeyT, ValueT, hash_function, equals_function, copy_key_function,
+ *                                free_key_function);
+ * defines a map that owns copies of its keys, e.g. of strings, where
+ *  - copy_key_function: bool (KeyT key, KeyT *copy), returns false if memory can't be allocated
+ *  - free_key_function: void (KeyT key)
+ *
+ * name_t *name_new(size_t capacity), returns NULL if sufficient amount of memory can't be allocated
+ * void name_free(name_t *map)
+ * size_t name_size(name_t *map)
+ * ValueT *name_get(name_t *map, KeyT key)
+ * ValueT *name_get_or_put(name_t *map, KeyT key, ValueT value, bool *inserted)
+ * void name_put(name_t *map, KeyT key, ValueT value)
+ * bool name_remove(name_t *map, KeyT key, ValueT *value), value can be NULL
+ * void name_clear(name_t *map)
+ * name_entry_t *name_next_entry(name_t *map, size_t *index), iterates starting from *index = 0, returns NULL at the end
+ * bool name_is_ok(name_t *map)
+ * bool name_log_on_error(name_t *map)
+ * The functions behave as their HM172Map counterparts, setting the map status if memory can't be allocated
+ */
+
+#include <malloc.h>
+#include <memory.h>
+#include <stdbool.h>
+#include "control_group.h"
+#include "status.h"
+
+/*
+ * The same maximum load factor as ENGINE_OPEN_ADDRESSING, 0.875
+ */
+static inline size_t hm172_generic_map_threshold(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+static inline size_t hm172_generic_map_capacity(size_t capacity) {
+    size_t valid_capacity = GROUP_WIDTH;
+    while (valid_capacity < capacity && valid_capacity <= SIZE_MAX / 4) valid_capacity <<= 1u;
+    return valid_capacity;
+}
+
+#define HM172_DEFINE_MAP(name, KeyT, ValueT, hash_function, equals_function)                                           \
+static inline bool name##_copy_key(KeyT key, KeyT *copy) {                                                             \
+    *copy = key;                                                                                                       \
+    return true;                                                                                                       \
+}                                                                                                                      \
+                                                                                                                       \
+static inline void name##_free_key(KeyT key) {                                                                         \
+    (void) key;                                                                                                        \
+}                                                                                                                      \
+                                                                                                                       \
+HM172_DEFINE_MAP_WITH_KEY_COPY(name, KeyT, ValueT, hash_function, equals_function, name##_copy_key, name##_free_key)
+
+/*
+ * Ends with a declaration, so that the macro is used as one followed by ';'
+ */
+#define HM172_DEFINE_MAP_WITH_KEY_COPY(name, KeyT, ValueT, hash_function, equals_function, copy_key_function,           \
+                                       free_key_function)                                                              \
+typedef struct {                                                                                                       \
+    KeyT key;                                                                                                          \
+    ValueT value;                                                                                                      \
+} name##_entry_t;                                                                                                      \
+                                                                                                                       \
+typedef struct {                                                                                                       \
+    name##_entry_t *slots; /* followed by the control bytes in the same allocation */                                  \
+    HM172Control *controls;                                                                                            \
+    size_t capacity;                                                                                                   \
+    size_t size;                                                                                                       \
+    size_t deleted_count;                                                                                              \
+    size_t threshold; /* of size + deleted_count */                                                                    \
+    HM172Status status;                                                                                                \
+} name##_t;                                                                                                            \
+                                                                                                                       \
+static inline bool name##_init_table(name##_t *map, size_t capacity) {                                                 \
+    if (capacity > SIZE_MAX / (sizeof(name##_entry_t) + sizeof(HM172Control))) return false;                           \
+    name##_entry_t *slots = malloc(capacity * (sizeof(name##_entry_t) + sizeof(HM172Control)));                        \
+    if (slots == NULL) return false;                                                                                   \
+    map->slots = slots;                                                                                                \
+    map->controls = (HM172Control *) (slots + capacity);                                                               \
+    memset(map->controls, CONTROL_EMPTY, capacity * sizeof(HM172Control));                                             \
+    map->capacity = capacity;                                                                                          \
+    map->deleted_count = 0;                                                                                            \
+    map->threshold = hm172_generic_map_threshold(capacity);                                                            \
+    return true;                                                                                                       \
+}                                                                                                                      \
+                                                                                                                       \
+static inline name##_t *name##_new(size_t capacity) {                                                                  \
+    name##_t *map = malloc(sizeof(name##_t));                                                                          \
+    if (map == NULL) return NULL;                                                                                      \
+    if (!name##_init_table(map, hm172_generic_map_capacity(capacity))) {                                               \
+        free(map);                                                                                                     \
+        return NULL;                                                                                                   \
+    }                                                                                                                  \
+    map->size = 0;                                                                                                     \
+    map->status = (HM172Status) {STATUS_OK, NULL};                                                                     \
+    return map;                                                                                                        \
+}                                                                                                                      \
+                                                                                                                       \
+static inline size_t name##_size(name##_t *map) {                                                                      \
+    return map->size;                                                                                                  \
+}                                                                                                                      \
+                                                                                                                       \
+/*                                                                                                                     \
+ * Doubles the capacity, or rehashes the table at the same capacity if most of the threshold is taken by deleted slots \
+ */                                                                                                                    \
+static inline bool name##_grow(name##_t *map) {                                                                        \
+    name##_entry_t *old_slots = map->slots;                                                                            \
+    HM172Control *old_controls = map->controls;                                                                        \
+    size_t old_capacity = map->capacity;                                                                               \
+    if (!name##_init_table(map, map->size > map->threshold / 2 ? old_capacity << 1u : old_capacity)) {                 \
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "resized table"};                                           \
+        return false;                                                                                                  \
+    }                                                                                                                  \
+    for (size_t i = 0; i < old_capacity; i++) {                                                                        \
+        if (old_controls[i] & CONTROL_EMPTY) continue;                                                                 \
+        uint64_t mixed_hash = hm172_mix_hash(hash_function(old_slots[i].key));                                         \
+        size_t index = hm172_find_free_slot(map->controls, map->capacity, mixed_hash);                                 \
+        map->controls[index] = hm172_fingerprint(mixed_hash);                                                          \
+        map->slots[index] = old_slots[i];                                                                              \
+    }                                                                                                                  \
+    free(old_slots);                                                                                                   \
+    return true;                                                                                                       \
+}                                                                                                                      \
+                                                                                                                       \
+/*                                                                                                                     \
+ * Returns the index of the slot holding the key, or SIZE_MAX if there's no such slot                                  \
+ */                                                                                                                    \
+static inline size_t name##_find_index(name##_t *map, KeyT key, uint64_t mixed_hash) {                                 \
+    HM172Control fingerprint = hm172_fingerprint(mixed_hash);                                                          \
+    size_t group_count = map->capacity / GROUP_WIDTH;                                                                  \
+    size_t group = mixed_hash & (group_count - 1);                                                                     \
+    for (size_t step = 1; step <= group_count; step++) {                                                               \
+        const HM172Control *group_controls = map->controls + group * GROUP_WIDTH;                                      \
+        for (HM172GroupMask mask = hm172_match_byte(group_controls, fingerprint); mask != 0; mask &= mask - 1) {       \
+            size_t index = group * GROUP_WIDTH + hm172_lowest_set_bit(mask);                                           \
+            if (equals_function(map->slots[index].key, key)) return index;                                             \
+        }                                                                                                              \
+        if (hm172_match_empty(group_controls) != 0) return SIZE_MAX;                                                   \
+        group = (group + step) & (group_count - 1);                                                                    \
+    }                                                                                                                  \
+    return SIZE_MAX;                                                                                                   \
+}                                                                                                                      \
+                                                                                                                       \
+static inline ValueT *name##_get(name##_t *map, KeyT key) {                                                            \
+    size_t index = name##_find_index(map, key, hm172_mix_hash(hash_function(key)));                                    \
+    return index == SIZE_MAX ? NULL : &map->slots[index].value;                                                        \
+}                                                                                                                      \
+                                                                                                                       \
+/*                                                                                                                     \
+ * The table grows before a new entry is placed, so the free slot is looked up once in the final table                 \
+ * If it can't grow, the entry is still placed while there are free slots                                              \
+ */                                                                                                                    \
+static inline ValueT *name##_get_or_put(name##_t *map, KeyT key, ValueT value, bool *inserted) {                       \
+    uint64_t mixed_hash = hm172_mix_hash(hash_function(key));                                                          \
+    size_t index = name##_find_index(map, key, mixed_hash);                                                            \
+    if (inserted != NULL) *inserted = false;                                                                           \
+    if (index != SIZE_MAX) return &map->slots[index].value;                                                            \
+    KeyT key_copy;                                                                                                     \
+    if (!copy_key_function(key, &key_copy)) {                                                                          \
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "key copy"};                                                \
+        return NULL;                                                                                                   \
+    }                                                                                                                  \
+    if (map->size + map->deleted_count >= map->threshold && !name##_grow(map) && map->size == map->capacity) {         \
+        free_key_function(key_copy);                                                                                   \
+        return NULL;                                                                                                   \
+    }                                                                                                                  \
+    index = hm172_find_free_slot(map->controls, map->capacity, mixed_hash);                                            \
+    if (map->controls[index] == CONTROL_DELETED) map->deleted_count--;                                                 \
+    map->controls[index] = hm172_fingerprint(mixed_hash);                                                              \
+    map->slots[index].key = key_copy;                                                                                  \
+    map->slots[index].value = value;                                                                                   \
+    map->size++;                                                                                                       \
+    if (inserted != NULL) *inserted = true;                                                                            \
+    return &map->slots[index].value;                                                                                   \
+}                                                                                                                      \
+                                                                                                                       \
+static inline void name##_put(name##_t *map, KeyT key, ValueT value) {                                                 \
+    bool inserted;                                                                                                     \
+    ValueT *existing = name##_get_or_put(map, key, value, &inserted);                                                  \
+    if (existing != NULL && !inserted) *existing = value;                                                              \
+}                                                                                                                      \
+                                                                                                                       \
+static inline bool name##_remove(name##_t *map, KeyT key, ValueT *value) {                                             \
+    size_t index = name##_find_index(map, key, hm172_mix_hash(hash_function(key)));                                    \
+    if (index == SIZE_MAX) return false;                                                                               \
+    if (value != NULL) *value = map->slots[index].value;                                                               \
+    free_key_function(map->slots[index].key);                                                                          \
+    if (hm172_erase_control(map->controls, index)) map->deleted_count++;                                               \
+    map->size--;                                                                                                       \
+    return true;                                                                                                       \
+}                                                                                                                      \
+                                                                                                                       \
+static inline name##_entry_t *name##_next_entry(name##_t *map, size_t *index) {                                        \
+    while (*index < map->capacity) {                                                                                   \
+        size_t current = (*index)++;                                                                                   \
+        if (!(map->controls[current] & CONTROL_EMPTY)) return map->slots + current;                                    \
+    }                                                                                                                  \
+    return NULL;                                                                                                       \
+}                                                                                                                      \
+                                                                                                                       \
+static inline void name##_clear(name##_t *map) {                                                                       \
+    for (size_t i = 0; i < map->capacity; i++)                                                                         \
+        if (!(map->controls[i] & CONTROL_EMPTY)) free_key_function(map->slots[i].key);                                 \
+    memset(map->controls, CONTROL_EMPTY, map->capacity * sizeof(HM172Control));                                        \
+    map->size = 0;                                                                                                     \
+    map->deleted_count = 0;                                                                                            \
+}                                                                                                                      \
+                                                                                                                       \
+static inline void name##_free(name##_t *map) {                                                                        \
+    if (map != NULL) {                                                                                                 \
+        name##_clear(map);                                                                                             \
+        free(map->slots);                                                                                              \
+        free(map);                                                                                                     \
+    }                                                                                                                  \
+}                                                                                                                      \
+                                                                                                                       \
+static inline bool name##_is_ok(name##_t *map) {                                                                       \
+    return hm172_is_status_ok(&map->status);                                                                           \
+}                                                                                                                      \
+                                                                                                                       \
+static inline bool name##_log_on_error(name##_t *map) {                                                                \
+    return hm172_log_status_on_error(&map->status, #name);                                                             \
+}                                                                                                                      \
+                                                                                                                       \
+_Static_assert(sizeof(HM172Control) == 1, "control bytes are matched a group at a time")
+
+#endif // HASHMAP_172_GENERIC_MAP_H
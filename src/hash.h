@@ -3,7 +3,16 @@
 
 #include <stdint.h>
 
+/*
+ * HM172_HASH_64 makes hashes 64 bit wide, which lets tables grow beyond 2^32 buckets and keeps more distinct hash bits
+ * for fingerprints at large capacities
+ */
+#ifdef HM172_HASH_64
+#define HASH_MAX UINT64_MAX
+typedef uint64_t HM172Hash;
+#else
 #define HASH_MAX UINT32_MAX
 typedef uint32_t HM172Hash;
+#endif
 
 #endif // HASHMAP_172_HASH_H
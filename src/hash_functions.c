@@ -1,4 +1,15 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "hash_functions.h"
+#include "mum_hash.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 HM172Hash hm172_polynomial_hash(char *str) {
     HM172Hash hash = 0;
@@ -6,3 +17,134 @@ HM172Hash hm172_polynomial_hash(char *str) {
         hash = 31 * hash + *str++;
     return hash;
 }
+
+HM172Hash hm172_polynomial_hash_n(const char *str, size_t length, uint64_t seed) {
+    HM172Hash hash = (HM172Hash) seed;
+    for (const char *end = str + length; str != end; str++)
+        hash = 31 * hash + *str;
+    return hash;
+}
+
+static const uint64_t PRIME_0 = HM172_MUM_PRIME_0;
+static const uint64_t PRIME_1 = HM172_MUM_PRIME_1;
+static const uint64_t PRIME_2 = HM172_MUM_PRIME_2;
+static const uint64_t PRIME_3 = HM172_MUM_PRIME_3;
+
+HM172Hash hm172_mum_hash(const char *str, size_t length, uint64_t seed) {
+    return hm172_mum_hash_inline(str, length, seed);
+}
+
+uint64_t hm172_mum_hash_64(const char *str, size_t length, uint64_t seed) {
+    return hm172_mum_hash_64_inline(str, length, seed);
+}
+
+#define LANE_COUNT 8
+#define STRIPE_LENGTH (LANE_COUNT * sizeof(uint64_t))
+#define STRIPES_PER_BLOCK 8
+#define BLOCK_LENGTH (STRIPES_PER_BLOCK * STRIPE_LENGTH)
+#define SECRET_LENGTH (STRIPES_PER_BLOCK + LANE_COUNT)
+
+static const size_t MAX_MUM_HASH_LENGTH = 256;
+static const uint64_t PRIME_32 = UINT64_C(0x9E3779B1);
+
+/*
+ * Stripe i is mixed with the secret words starting from index i, the last LANE_COUNT words scramble accumulators
+ */
+static const uint64_t DEFAULT_SECRET[SECRET_LENGTH] = {
+        UINT64_C(0x8C796002B16266DA), UINT64_C(0xFE7E613D9F7511DA),
+        UINT64_C(0x9D76E96B9B0B427B), UINT64_C(0x1274B77C06F83216),
+        UINT64_C(0xC692711C91A039D0), UINT64_C(0x747A4BB85AC69870),
+        UINT64_C(0xD9CB7ED0188E07DF), UINT64_C(0xB6EE5CB5F20A7D11),
+        UINT64_C(0xAE8BD51E0CC46DBC), UINT64_C(0xE8BE73414A04D4A1),
+        UINT64_C(0xB8EED76292E9BCFE), UINT64_C(0xBFCDA1806694B861),
+        UINT64_C(0x9E1834508EDEB409), UINT64_C(0x5FD9F068F935D9E2),
+        UINT64_C(0x714E8C4BA805A485), UINT64_C(0x4D26BF65C8A1683A),
+};
+
+/*
+ * For each lane: accumulator += low32(data ^ secret) * high32(data ^ secret), and the neighbour lane accumulates the data
+ * itself, so that the multiplication by zero halves doesn't lose the input
+ */
+static void accumulate_stripe(uint64_t *accumulators, const unsigned char *stripe, const uint64_t *secret) {
+#if defined(__AVX2__)
+    for (unsigned i = 0; i < LANE_COUNT; i += 4) {
+        __m256i data = _mm256_loadu_si256((const __m256i *) (stripe + i * sizeof(uint64_t)));
+        __m256i keyed = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *) (secret + i)));
+        __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+        __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i *accumulator = (__m256i *) (accumulators + i);
+        _mm256_storeu_si256(accumulator, _mm256_add_epi64(_mm256_loadu_si256(accumulator),
+                                                          _mm256_add_epi64(product, swapped)));
+    }
+#elif defined(__SSE2__)
+    for (unsigned i = 0; i < LANE_COUNT; i += 2) {
+        __m128i data = _mm_loadu_si128((const __m128i *) (stripe + i * sizeof(uint64_t)));
+        __m128i keyed = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *) (secret + i)));
+        __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+        __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i *accumulator = (__m128i *) (accumulators + i);
+        _mm_storeu_si128(accumulator, _mm_add_epi64(_mm_loadu_si128(accumulator), _mm_add_epi64(product, swapped)));
+    }
+#else
+    for (unsigned i = 0; i < LANE_COUNT; i++) {
+        uint64_t data = hm172_read_64(stripe + i * sizeof(uint64_t));
+        uint64_t keyed = data ^ secret[i];
+        accumulators[i ^ 1u] += data;
+        accumulators[i] += (keyed & UINT32_MAX) * (keyed >> 32u);
+    }
+#endif
+}
+
+/*
+ * Spreads the high bits of the accumulators back to the low ones, which are the only ones used by multiplications
+ */
+static void scramble_accumulators(uint64_t *accumulators, const uint64_t *secret) {
+    for (unsigned i = 0; i < LANE_COUNT; i++) {
+        uint64_t accumulator = accumulators[i];
+        accumulator ^= accumulator >> 47u;
+        accumulator ^= secret[i];
+        accumulators[i] = accumulator * PRIME_32;
+    }
+}
+
+static uint64_t stripe_hash_64(const unsigned char *bytes, size_t length, uint64_t seed) {
+    uint64_t secret[SECRET_LENGTH];
+    for (unsigned i = 0; i < SECRET_LENGTH; i++)
+        secret[i] = DEFAULT_SECRET[i] + ((i & 1u) ? -seed : seed);
+    uint64_t accumulators[LANE_COUNT] = {PRIME_32, PRIME_0, PRIME_1, PRIME_2, PRIME_3, PRIME_32 ^ seed, PRIME_0, PRIME_1};
+    size_t block_count = (length - 1) / BLOCK_LENGTH;
+    for (size_t block = 0; block < block_count; block++, bytes += BLOCK_LENGTH) {
+        for (unsigned stripe = 0; stripe < STRIPES_PER_BLOCK; stripe++)
+            accumulate_stripe(accumulators, bytes + stripe * STRIPE_LENGTH, secret + stripe);
+        scramble_accumulators(accumulators, secret + STRIPES_PER_BLOCK);
+    }
+    // the last block is partial: full stripes first, then the last STRIPE_LENGTH bytes of the key as an overlapping stripe
+    size_t left = length - block_count * BLOCK_LENGTH;
+    size_t stripe_count = (left - 1) / STRIPE_LENGTH;
+    for (unsigned stripe = 0; stripe < stripe_count; stripe++)
+        accumulate_stripe(accumulators, bytes + stripe * STRIPE_LENGTH, secret + stripe);
+    accumulate_stripe(accumulators, bytes + left - STRIPE_LENGTH, secret + STRIPES_PER_BLOCK - 1);
+    uint64_t hash = length * PRIME_0;
+    for (unsigned i = 0; i < LANE_COUNT; i += 2)
+        hash += hm172_mum_mix(accumulators[i] ^ secret[STRIPES_PER_BLOCK + i], accumulators[i + 1] ^ secret[STRIPES_PER_BLOCK + i + 1]);
+    hash ^= hash >> 37u;
+    hash *= UINT64_C(0x165667919E3779F9);
+    return hash ^ (hash >> 32u);
+}
+
+HM172Hash hm172_stripe_hash(const char *str, size_t length, uint64_t seed) {
+    if (length <= MAX_MUM_HASH_LENGTH) return hm172_mum_hash(str, length, seed);
+    return hm172_fold_hash(stripe_hash_64((const unsigned char *) str, length, seed));
+}
+
+uint64_t hm172_random_seed(void) {
+    uint64_t seed;
+    FILE *source = fopen("/dev/urandom", "rb");
+    bool is_read = source != NULL && fread(&seed, sizeof(seed), 1, source) == 1;
+    if (source != NULL) fclose(source);
+    if (is_read) return seed;
+    struct timespec time = {0};
+    timespec_get(&time, TIME_UTC);
+    uint64_t mixed = (uint64_t) time.tv_sec * PRIME_0 ^ (uint64_t) time.tv_nsec * PRIME_1 ^ (uint64_t) (uintptr_t) &seed;
+    return mixed ^ (mixed >> 29u) * PRIME_2;
+}
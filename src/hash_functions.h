@@ -1,6 +1,7 @@
 #ifndef HASHMAP_172_HASH_FUNCTIONS_H
 #define HASHMAP_172_HASH_FUNCTIONS_H
 
+#include <stddef.h>
 #include "hash.h"
 
 /*
@@ -8,4 +9,34 @@
  */
 HM172Hash hm172_polynomial_hash(char *str);
 
+/*
+ * Same as hm172_polynomial_hash for the first length characters of the str, which doesn't need to be followed by '\0'
+ * The seed is added as seed*p^n, so zero seed gives the same hashes as hm172_polynomial_hash
+ */
+HM172Hash hm172_polynomial_hash_n(const char *str, size_t length, uint64_t seed);
+
+/*
+ * Word-at-a-time hash in the style of wyhash: reads the str 8 bytes at a time and mixes the words with 64x64->128 bit
+ * multiplications, so that all the bits of the result are well mixed, including the low ones used for bucket selection
+ * Different seeds give independent hash functions
+ */
+HM172Hash hm172_mum_hash(const char *str, size_t length, uint64_t seed);
+
+/*
+ * hm172_mum_hash before it's folded to HM172Hash, for the callers that need 64 bits whatever HM172_HASH_64 is
+ */
+uint64_t hm172_mum_hash_64(const char *str, size_t length, uint64_t seed);
+
+/*
+ * Same as hm172_mum_hash for strs not longer than 256 characters, longer strs are hashed in the style of xxh3:
+ * 64 byte stripes are accumulated into 8 independent 64 bit lanes using SSE2 or AVX2 where available
+ */
+HM172Hash hm172_stripe_hash(const char *str, size_t length, uint64_t seed);
+
+/*
+ * Returns a seed read from the system random source, or mixed from the time and a stack address if it can't be read
+ * The collisions of the hash functions with secret random seeds can't be precomputed, unlike the ones of fixed seeds
+ */
+uint64_t hm172_random_seed(void);
+
 #endif // HASHMAP_172_HASH_FUNCTIONS_H
@@ -0,0 +1,89 @@
+#include <malloc.h>
+#include <math.h>
+#include "hyperloglog.h"
+#include "hash_functions.h"
+
+struct hyperloglog_t {
+    unsigned precision;
+    size_t register_count; // 2^precision
+    uint8_t *registers; // the maximum rank of the hashes with the register index in their top precision bits
+};
+
+HM172HyperLogLog *hm172_new_hyperloglog(unsigned precision) {
+    if (precision < HM172_MIN_HYPERLOGLOG_PRECISION) precision = HM172_MIN_HYPERLOGLOG_PRECISION;
+    if (precision > HM172_MAX_HYPERLOGLOG_PRECISION) precision = HM172_MAX_HYPERLOGLOG_PRECISION;
+    HM172HyperLogLog *sketch = malloc(sizeof(HM172HyperLogLog));
+    if (sketch == NULL) return NULL;
+    sketch->precision = precision;
+    sketch->register_count = (size_t) 1 << precision;
+    sketch->registers = calloc(sketch->register_count, sizeof(uint8_t));
+    if (sketch->registers == NULL) {
+        free(sketch);
+        return NULL;
+    }
+    return sketch;
+}
+
+void hm172_free_hyperloglog(HM172HyperLogLog *sketch) {
+    if (sketch != NULL) free(sketch->registers);
+    free(sketch);
+}
+
+/*
+ * Finalizer of MurmurHash3, spreads every input bit over all the output bits
+ */
+static uint64_t mix_hash(uint64_t hash) {
+    hash ^= hash >> 33u;
+    hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    hash ^= hash >> 33u;
+    hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    return hash ^ (hash >> 33u);
+}
+
+void hm172_hyperloglog_add(HM172HyperLogLog *sketch, const char *key, size_t length) {
+    hm172_hyperloglog_add_hash(sketch, hm172_mum_hash_64(key, length, 0));
+}
+
+/*
+ * The rank is the position of the first set bit after the index bits, the set guard bit limits it
+ * to 64 - precision + 1 for the hashes with no set bits there
+ */
+void hm172_hyperloglog_add_hash(HM172HyperLogLog *sketch, uint64_t hash) {
+    uint64_t mixed_hash = mix_hash(hash);
+    size_t index = (size_t) (mixed_hash >> (64u - sketch->precision));
+    uint64_t rest = (mixed_hash << sketch->precision) | ((uint64_t) 1 << (sketch->precision - 1));
+    uint8_t rank = (uint8_t) (__builtin_clzll(rest) + 1);
+    if (rank > sketch->registers[index]) sketch->registers[index] = rank;
+}
+
+void hm172_hyperloglog_merge(HM172HyperLogLog *sketch, const HM172HyperLogLog *other_sketch) {
+    for (size_t i = 0; i < sketch->register_count; i++)
+        if (other_sketch->registers[i] > sketch->registers[i]) sketch->registers[i] = other_sketch->registers[i];
+}
+
+static double get_alpha(size_t register_count) {
+    switch (register_count) {
+        case 16: return 0.673;
+        case 32: return 0.697;
+        case 64: return 0.709;
+        default: return 0.7213 / (1 + 1.079 / (double) register_count);
+    }
+}
+
+/*
+ * The harmonic mean estimate, replaced with linear counting of the empty registers for small cardinalities,
+ * where the harmonic mean is biased
+ */
+size_t hm172_hyperloglog_estimate(const HM172HyperLogLog *sketch) {
+    double register_count = (double) sketch->register_count;
+    double inverse_sum = 0;
+    size_t empty_count = 0;
+    for (size_t i = 0; i < sketch->register_count; i++) {
+        inverse_sum += 1.0 / (double) ((uint64_t) 1 << sketch->registers[i]);
+        empty_count += sketch->registers[i] == 0;
+    }
+    double estimate = get_alpha(sketch->register_count) * register_count * register_count / inverse_sum;
+    if (estimate <= 2.5 * register_count && empty_count != 0)
+        estimate = register_count * log(register_count / (double) empty_count);
+    return (size_t) (estimate + 0.5);
+}
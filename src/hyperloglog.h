@@ -0,0 +1,49 @@
+#ifndef HASHMAP_172_HYPERLOGLOG_H
+#define HASHMAP_172_HYPERLOGLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HyperLogLog sketch estimating the number of distinct keys in a stream in 2^precision bytes, e.g. to pass
+ * the estimate to hm172_reserve before a bulk load instead of guessing the initial capacity
+ * The relative standard error of the estimate is about 1.04 / sqrt(2^precision), 1.6% for precision 12
+ */
+typedef struct hyperloglog_t HM172HyperLogLog;
+
+#define HM172_MIN_HYPERLOGLOG_PRECISION 4
+#define HM172_MAX_HYPERLOGLOG_PRECISION 18
+
+/*
+ * The precision is clamped to the range from HM172_MIN_HYPERLOGLOG_PRECISION to HM172_MAX_HYPERLOGLOG_PRECISION
+ * If sufficient amount of memory can't be allocated, NULL is returned
+ */
+HM172HyperLogLog *hm172_new_hyperloglog(unsigned precision);
+
+void hm172_free_hyperloglog(HM172HyperLogLog *sketch);
+
+/*
+ * Adds the key of the given length, hashed with hm172_mum_hash_64
+ */
+void hm172_hyperloglog_add(HM172HyperLogLog *sketch, const char *key, size_t length);
+
+/*
+ * Adds a key by its hash, e.g. the one computed once for hm172_put_hashed, all the keys of the sketch must be hashed
+ * with the same function, which is remixed, so it doesn't need to mix the high bits well
+ * Distinct keys with equal hashes are counted once, so with 32 bit HM172Hash hashes the estimates of more than
+ * about 10^8 keys are low
+ */
+void hm172_hyperloglog_add_hash(HM172HyperLogLog *sketch, uint64_t hash);
+
+/*
+ * Adds the keys of the other sketch, which must have the same precision and hashes, e.g. to combine the sketches
+ * of the parts of the input fed by separate threads
+ */
+void hm172_hyperloglog_merge(HM172HyperLogLog *sketch, const HM172HyperLogLog *other_sketch);
+
+/*
+ * Returns the estimated number of distinct keys added
+ */
+size_t hm172_hyperloglog_estimate(const HM172HyperLogLog *sketch);
+
+#endif // HASHMAP_172_HYPERLOGLOG_H
@@ -1,35 +1,52 @@
 #include <malloc.h>
 #include <memory.h>
-#include "map.h"
+#include <inttypes.h>
+#include <time.h>
+#include "map_engine.h"
+#include "hash_functions.h"
+
+#define HASH_BUFFER_SIZE 256
+#define BATCH_WINDOW 16
 
 /*
- * For all non-negative integers x < MAX_CAPACITY:
- *  - 2x must be within the range of size_t type
- *  - x must be within the range of HM172Hash type
+ * Returns the size of the memory allocated for a key of the given length, which is 0 for inline keys
  */
-static const size_t MAX_CAPACITY = 1 + ((HASH_MAX < SIZE_MAX / 2) ? HASH_MAX : (SIZE_MAX / 2));
+static size_t get_key_copy_size(size_t length) {
+    return hm172_is_key_inline(length) ? 0 : (length + 1) * sizeof(char); // including '\0'
+}
 
-struct entry_t {
-    HM172Key key;
-    HM172Value value;
-    HM172Hash hash;
-    HM172Entry *next;
-};
+bool hm172_set_entry_key(HM172Map *map, HM172Entry *entry, HM172ConstKey key, size_t length) {
+    HM172Key copy = entry->inline_key;
+    if (!hm172_is_key_inline(length)) {
+        size_t size = get_key_copy_size(length);
+        copy = map->uses_arena ? hm172_arena_alloc(&map->arena, size, 1) : hm172_allocate(map, size);
+        if (copy == NULL) return false;
+        entry->key = copy;
+    }
+    memcpy(copy, key, length);
+    copy[length] = '\0';
+    entry->key_length = length;
+    return true;
+}
 
-static bool are_equal_keys(HM172ConstKey key1, HM172ConstKey key2) {
-    return strcmp(key1, key2) == 0;
+static void free_key(HM172Map *map, HM172Entry *entry) {
+    if (!hm172_is_key_inline(entry->key_length)) hm172_deallocate(map, entry->key, get_key_copy_size(entry->key_length));
 }
 
-static HM172Key copy_key(HM172ConstKey key) {
-    size_t size = (strlen(key) + 1) * sizeof(char); // including '\0'
-    HM172Key copy = malloc(size);
-    if (copy == NULL) return NULL;
-    memcpy(copy, key, size);
-    return copy;
+void *hm172_alloc_node(HM172Map *map, size_t size) {
+    return map->uses_arena ? hm172_arena_alloc(&map->arena, size, sizeof(void *)) : hm172_allocate(map, size);
+}
+
+void hm172_free_node(HM172Map *map, void *node, size_t size) {
+    if (!map->uses_arena) hm172_deallocate(map, node, size);
 }
 
 HM172ConstKey hm172_get_entry_key(HM172Entry *entry) {
-    return entry->key;
+    return hm172_entry_key(entry);
+}
+
+size_t hm172_get_entry_key_length(HM172Entry *entry) {
+    return entry->key_length;
 }
 
 HM172Value hm172_get_entry_value(HM172Entry *entry) {
@@ -40,162 +57,554 @@ void hm172_set_entry_value(HM172Entry *entry, HM172Value value) {
     entry->value = value;
 }
 
-static HM172Entry *new_entry(HM172Key key, HM172Value value, HM172Hash hash) {
-    HM172Entry *entry = malloc(sizeof(HM172Entry));
-    if (entry == NULL) return NULL;
-    entry->key = key;
-    entry->value = value;
-    entry->hash = hash;
-    entry->next = NULL;
-    return entry;
+void hm172_update_threshold(HM172Map *map) {
+    map->threshold = (map->capacity == MAX_CAPACITY || map->load_factor < 0) ? -1 : map->capacity * map->load_factor;
+    map->shrink_threshold = (map->capacity == map->engine->min_capacity || map->shrink_load_factor <= 0)
+                            ? -1 : map->capacity * map->shrink_load_factor;
 }
 
-struct map_t {
-    HM172Entry **table;
-    hash_function_t hash_function;
-    HM172Status status;
-    size_t capacity; // must be a power of 2, can't be 0
-    unsigned modification_count; // increments on each map update, makes outdated iterators fail fast
-    size_t size;
-    float threshold; // negative if resizing disabled
-    float load_factor; // negative if resizing disabled
-};
-
-static HM172Entry **get_entry_ptr_by_key_and_hash(HM172Map *map, HM172Key key, HM172Hash hash) {
-    HM172Entry **entry_ptr = map->table + ((map->capacity - 1) & hash);
-    while (*entry_ptr != NULL) {
-        if ((*entry_ptr)->hash == hash && are_equal_keys(key, (*entry_ptr)->key)) return entry_ptr;
-        entry_ptr = &((*entry_ptr)->next);
-    }
-    return entry_ptr;
+/*
+ * Resize time is only measured with HM172_STATS, as reading the clock isn't free
+ */
+static uint64_t start_resize_timer(void) {
+#ifdef HM172_STATS
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+#else
+    return 0;
+#endif
 }
 
-static HM172Entry **get_entry_ptr_by_key(HM172Map *map, HM172Key key) {
-    return get_entry_ptr_by_key_and_hash(map, key, map->hash_function(key));
+static void stop_resize_timer(HM172Map *map, uint64_t start_time) {
+#ifdef HM172_STATS
+    map->counters.resize_nanoseconds += start_resize_timer() - start_time;
+#else
+    (void) map;
+    (void) start_time;
+#endif
 }
 
-static void update_threshold(HM172Map *map) {
-    map->threshold = (map->capacity == MAX_CAPACITY || map->load_factor < 0) ? -1 : map->capacity * map->load_factor;
+/*
+ * Reallocates the table with the new capacity, migrating the entries at once unless resizing is incremental
+ */
+static void resize(HM172Map *map, size_t new_capacity) {
+    uint64_t start_time = start_resize_timer();
+    // a resize can't start before the previous one is finished
+    if (map->old_table != NULL) map->engine->migrate(map, SIZE_MAX);
+    map->engine->start_resize(map, new_capacity);
+    if (map->old_table != NULL) {
+#ifdef HM172_STATS
+        map->counters.resize_count++;
+#endif
+        if (map->resize_step == 0) map->engine->migrate(map, SIZE_MAX);
+        hm172_update_threshold(map);
+    }
+    stop_resize_timer(map, start_time);
 }
 
-static void double_capacity(HM172Map *map) {
+/*
+ * Doubles the capacity, or rehashes the table at the same capacity if most of the threshold is taken by deleted slots
+ */
+static void grow(HM172Map *map) {
     map->modification_count++;
-    size_t new_capacity = map->capacity << 1u;
+    size_t new_capacity = (float) map->size > map->threshold / 2 ? map->capacity << 1u : map->capacity;
     if(new_capacity > MAX_CAPACITY) {
         map->threshold = -1;
         return;
     }
-    HM172Entry **new_table = calloc(new_capacity, sizeof(HM172Entry *));
-    if (new_table == NULL) {
-        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "resized table"};
-        return;
-    }
-    for (size_t i = 0; i < map->capacity; i++) {
-        HM172Entry *lowHead = NULL, *lowTail = NULL, *highHead = NULL, *highTail = NULL;
-        for (HM172Entry *entry = map->table[i]; entry != NULL; entry = entry->next) {
-            if (entry->hash & map->capacity) {
-                if (highTail == NULL) highHead = entry;
-                else highTail->next = entry;
-                highTail = entry;
-            } else {
-                if (lowTail == NULL) lowHead = entry;
-                else lowTail->next = entry;
-                lowTail = entry;
-            }
-        }
-        if (lowTail != NULL) {
-            lowTail->next = NULL;
-            new_table[i] = lowHead;
-        }
-        if (highTail != NULL) {
-            highTail->next = NULL;
-            new_table[i + map->capacity] = highHead;
-        }
-    }
-    free(map->table);
-    map->table = new_table;
-    map->capacity = new_capacity;
-    update_threshold(map);
+    resize(map, new_capacity);
+}
+
+static void migrate_step(HM172Map *map) {
+    if (map->old_table == NULL) return;
+    uint64_t start_time = start_resize_timer();
+    map->engine->migrate(map, map->resize_step);
+    stop_resize_timer(map, start_time);
 }
 
 size_t hm172_size(HM172Map *map) {
     return map->size;
 }
 
+HM172Hash hm172_hash_key(HM172Map *map, HM172ConstKey key, size_t length) {
+    if (map->hash_n_function != NULL) return map->hash_n_function(key, length, map->hash_seed);
+    // hash_function_t requires '\0'-terminated keys
+    char buffer[HASH_BUFFER_SIZE];
+    HM172Key terminated_key = length < HASH_BUFFER_SIZE ? buffer : malloc(length + 1);
+    if (terminated_key == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "terminated key"};
+        return 0;
+    }
+    memcpy(terminated_key, key, length);
+    terminated_key[length] = '\0';
+    HM172Hash hash = map->hash_function(terminated_key);
+    if (terminated_key != buffer) free(terminated_key);
+    return hash;
+}
+
+uint64_t hm172_get_hash_seed(HM172Map *map) {
+    return map->hash_seed;
+}
+
+static HM172Hash hash_terminated_key(HM172Map *map, HM172Key key, size_t length) {
+    return map->hash_n_function != NULL ? map->hash_n_function(key, length, map->hash_seed) : map->hash_function(key);
+}
+
+/*
+ * Returns the entry with the key, creating it with the value if there's no such entry, or returns NULL on error
+ * Sets *inserted to whether the entry is new
+ */
+static HM172Entry *get_or_put_entry(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash,
+                                    HM172Value value, bool *inserted) {
+    HM172Entry *entry = map->engine->find_or_insert(map, key, length, hash, inserted);
+    if (entry == NULL || !*inserted) return entry;
+    map->modification_count++;
+    if (!hm172_set_entry_key(map, entry, key, length)) {
+        map->engine->undo_insert(map, entry);
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "key copy"};
+        return NULL;
+    }
+    entry->value = value;
+    map->size++;
+#ifdef HM172_STATS
+    map->counters.key_bytes += get_key_copy_size(length);
+#endif
+    if (map->threshold >= 0 && (float) (map->size + map->deleted_count) > map->threshold) {
+        grow(map);
+        entry = map->engine->find(map, key, length, hash); // entries of some engines move on resize
+    }
+    return entry;
+}
+
+void hm172_put_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash, HM172Value value) {
+    map->modification_count++;
+    migrate_step(map);
+    bool inserted;
+    HM172Entry *entry = get_or_put_entry(map, key, length, hash, value, &inserted);
+    if (entry != NULL && !inserted) entry->value = value;
+}
+
+void hm172_put_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value) {
+    hm172_put_hashed(map, key, length, hm172_hash_key(map, key, length), value);
+}
+
 void hm172_put(HM172Map *map, HM172Key key, HM172Value value) {
+    size_t length = strlen(key);
+    hm172_put_hashed(map, key, length, hash_terminated_key(map, key, length), value);
+}
+
+/*
+ * Whether the entries stay where they are when they are migrated, i.e. are separately allocated nodes,
+ * so that lookups, which aren't modifications, can migrate without invalidating the pointers returned before
+ */
+static bool lookups_can_migrate(HM172Map *map) {
+    return map->iterator_count == 0 && map->engine->node_size != 0;
+}
+
+HM172Value *hm172_get_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash) {
+    if (lookups_can_migrate(map)) migrate_step(map);
+    HM172Entry *entry = map->engine->find(map, key, length, hash);
+    return entry == NULL ? NULL : &entry->value;
+}
+
+HM172Value *hm172_get_n(HM172Map *map, HM172ConstKey key, size_t length) {
+    return hm172_get_hashed(map, key, length, hm172_hash_key(map, key, length));
+}
+
+HM172Value *hm172_get(HM172Map *map, HM172Key key) {
+    size_t length = strlen(key);
+    return hm172_get_hashed(map, key, length, hash_terminated_key(map, key, length));
+}
+
+HM172Value *hm172_get_or_put_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash,
+                                    HM172Value value, bool *inserted) {
+    bool can_migrate = lookups_can_migrate(map);
+    if (can_migrate) migrate_step(map);
+    bool is_inserted;
+    HM172Entry *entry = get_or_put_entry(map, key, length, hash, value, &is_inserted);
+    if (entry != NULL && is_inserted && !can_migrate && map->old_table != NULL) {
+        // an insertion is a modification, so it can move the entries, including the inserted one
+        migrate_step(map);
+        entry = map->engine->find(map, key, length, hash);
+    }
+    if (inserted != NULL) *inserted = entry != NULL && is_inserted;
+    return entry == NULL ? NULL : &entry->value;
+}
+
+HM172Value *hm172_get_or_put_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value, bool *inserted) {
+    return hm172_get_or_put_hashed(map, key, length, hm172_hash_key(map, key, length), value, inserted);
+}
+
+HM172Value *hm172_get_or_put(HM172Map *map, HM172Key key, HM172Value value, bool *inserted) {
+    size_t length = strlen(key);
+    return hm172_get_or_put_hashed(map, key, length, hash_terminated_key(map, key, length), value, inserted);
+}
+
+HM172Value *hm172_update_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value initial_value,
+                           update_function_t update_function, void *context) {
+    HM172Value *value = hm172_get_or_put_n(map, key, length, initial_value, NULL);
+    if (value != NULL) *value = update_function(*value, context);
+    return value;
+}
+
+HM172Value *hm172_update(HM172Map *map, HM172Key key, HM172Value initial_value,
+                         update_function_t update_function, void *context) {
+    HM172Value *value = hm172_get_or_put(map, key, initial_value, NULL);
+    if (value != NULL) *value = update_function(*value, context);
+    return value;
+}
+
+/*
+ * Hashes the next window of the batch and prefetches the memory the lookups depend on, stage by stage for the whole
+ * window, so that the loads of different keys overlap instead of each lookup waiting for its own cache misses
+ * Returns the window size
+ */
+static size_t prepare_window(HM172Map *map, const HM172ConstKey *keys, const size_t *lengths, size_t n,
+                             size_t window_lengths[], HM172Hash window_hashes[]) {
+    size_t window_size = n < BATCH_WINDOW ? n : BATCH_WINDOW;
+    for (size_t i = 0; i < window_size; i++) {
+        window_lengths[i] = lengths != NULL ? lengths[i] : strlen(keys[i]);
+        window_hashes[i] = hm172_hash_key(map, keys[i], window_lengths[i]);
+        map->engine->prefetch(map, window_hashes[i], 0);
+    }
+    for (unsigned stage = 1; stage < PREFETCH_STAGE_COUNT; stage++)
+        for (size_t i = 0; i < window_size; i++)
+            map->engine->prefetch(map, window_hashes[i], stage);
+    return window_size;
+}
+
+void hm172_get_batch_n(HM172Map *map, const HM172ConstKey *keys, const size_t *lengths, size_t n,
+                       HM172Value **out_values) {
+    size_t window_lengths[BATCH_WINDOW];
+    HM172Hash window_hashes[BATCH_WINDOW];
+    // a single migration step for the whole batch, so that the values found earlier in the batch don't move
+    if (n > 0 && lookups_can_migrate(map)) migrate_step(map);
+    while (n > 0) {
+        size_t window_size = prepare_window(map, keys, lengths, n, window_lengths, window_hashes);
+        for (size_t i = 0; i < window_size; i++) {
+            HM172Entry *entry = map->engine->find(map, keys[i], window_lengths[i], window_hashes[i]);
+            out_values[i] = entry == NULL ? NULL : &entry->value;
+        }
+        keys += window_size;
+        if (lengths != NULL) lengths += window_size;
+        out_values += window_size;
+        n -= window_size;
+    }
+}
+
+void hm172_get_batch(HM172Map *map, const HM172ConstKey *keys, size_t n, HM172Value **out_values) {
+    hm172_get_batch_n(map, keys, NULL, n, out_values);
+}
+
+void hm172_put_batch_n(HM172Map *map, const HM172ConstKey *keys, const size_t *lengths, const HM172Value *values,
+                       size_t n) {
+    size_t window_lengths[BATCH_WINDOW];
+    HM172Hash window_hashes[BATCH_WINDOW];
+    while (n > 0) {
+        size_t window_size = prepare_window(map, keys, lengths, n, window_lengths, window_hashes);
+        // a resize in the middle of the window only makes the rest of the prefetches useless
+        for (size_t i = 0; i < window_size; i++)
+            hm172_put_hashed(map, keys[i], window_lengths[i], window_hashes[i], values[i]);
+        keys += window_size;
+        if (lengths != NULL) lengths += window_size;
+        values += window_size;
+        n -= window_size;
+    }
+}
+
+void hm172_put_batch(HM172Map *map, const HM172ConstKey *keys, const HM172Value *values, size_t n) {
+    hm172_put_batch_n(map, keys, NULL, values, n);
+}
+
+bool hm172_remove_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash, HM172Value *value) {
+    // a removal of an absent key isn't a modification, so it must not relink the buckets under live iterators
+    if (map->iterator_count == 0) migrate_step(map);
+    HM172Entry removed;
+    if (!map->engine->remove_entry(map, key, length, hash, &removed)) return false;
     map->modification_count++;
-    HM172Hash hash = map->hash_function(key);
-    HM172Entry **entry_ptr = get_entry_ptr_by_key_and_hash(map, key, hash);
-    if (*entry_ptr != NULL) {
-        (*entry_ptr)->value = value;
+    map->size--;
+#ifdef HM172_STATS
+    map->counters.key_bytes -= get_key_copy_size(removed.key_length);
+#endif
+    if (!map->uses_arena) free_key(map, &removed);
+    if (value != NULL) *value = removed.value;
+    if ((float) map->size < map->shrink_threshold) resize(map, map->capacity >> 1u);
+    return true;
+}
+
+bool hm172_remove_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value *value) {
+    return hm172_remove_hashed(map, key, length, hm172_hash_key(map, key, length), value);
+}
+
+bool hm172_remove(HM172Map *map, HM172Key key, HM172Value *value) {
+    size_t length = strlen(key);
+    return hm172_remove_hashed(map, key, length, hash_terminated_key(map, key, length), value);
+}
+
+/*
+ * Moves the entry nodes and the key copies to a new arena, leaving the memory of the removed entries in the old one
+ * The memory of the new arena is reserved at once, so that a failure leaves the map as is
+ */
+static void compact_arena(HM172Map *map) {
+    HM172EntryIterator iterator;
+    size_t key_bytes = 0;
+    hm172_init_entry_iterator(&iterator, map);
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL;)
+        key_bytes += get_key_copy_size(entry->key_length);
+    HM172Arena arena;
+    hm172_arena_init(&arena, &map->allocator);
+    // nodes are allocated first, so only the first one can need padding
+    size_t node_bytes = map->engine->move_nodes == NULL ? 0 : map->size * map->engine->node_size + sizeof(void *);
+    if (!hm172_arena_reserve(&arena, node_bytes + key_bytes)) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "compacted arena"};
         return;
     }
-    HM172Key key_copy = copy_key(key);
-    if (key_copy == NULL) {
-        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "key copy"};
-        return;
+    if (map->engine->move_nodes != NULL) map->engine->move_nodes(map, &arena);
+    hm172_init_entry_iterator(&iterator, map);
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL;) {
+        if (hm172_is_key_inline(entry->key_length)) continue;
+        HM172Key key = hm172_arena_alloc(&arena, get_key_copy_size(entry->key_length), 1);
+        memcpy(key, entry->key, get_key_copy_size(entry->key_length));
+        entry->key = key;
     }
-    HM172Entry *entry = new_entry(key_copy, value, hash);
-    if (entry == NULL) {
-        free(key_copy);
-        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "entry"};
-        return;
+    hm172_arena_free(&map->arena);
+    map->arena = arena;
+}
+
+static size_t capacity_to_valid_capacity(const engine_t *engine, size_t capacity) {
+    if (capacity > MAX_CAPACITY) capacity = MAX_CAPACITY;
+    size_t valid_capacity = engine->min_capacity;
+    while (valid_capacity < capacity) valid_capacity <<= 1u;
+    if (valid_capacity > MAX_CAPACITY) valid_capacity >>= 1u;
+    return valid_capacity;
+}
+
+/*
+ * Returns the smallest capacity of the engine that holds the given number of entries below the map load factor
+ */
+static size_t get_fitting_capacity(HM172Map *map, const engine_t *engine, size_t size) {
+    size_t capacity = engine->min_capacity;
+    while (capacity < MAX_CAPACITY && (float) size > capacity * map->load_factor) capacity <<= 1u;
+    return capacity;
+}
+
+/*
+ * Resizes the table at once to hold the given number of entries below the threshold, if it can't already
+ */
+static void reserve(HM172Map *map, size_t size) {
+    if (map->threshold < 0 || (float) (size + map->deleted_count) <= map->threshold) return;
+    map->modification_count++;
+    resize(map, get_fitting_capacity(map, map->engine, size));
+}
+
+void hm172_reserve(HM172Map *map, size_t size) {
+    reserve(map, size);
+}
+
+void hm172_shrink_to_fit(HM172Map *map) {
+    map->modification_count++;
+    if (map->load_factor >= 0) {
+        size_t capacity = get_fitting_capacity(map, map->engine, map->size);
+        if (capacity != map->capacity || map->deleted_count != 0) resize(map, capacity);
     }
-    *entry_ptr = entry;
-    map->size++;
-    if (map->threshold >= 0 && (float) map->size > map->threshold)
-        double_capacity(map);
+    if (map->old_table != NULL) map->engine->migrate(map, SIZE_MAX);
+    if (map->uses_arena) compact_arena(map);
 }
 
-HM172Value *hm172_get(HM172Map *map, HM172Key key) {
-    HM172Entry **entry_ptr = get_entry_ptr_by_key(map, key);
-    return *entry_ptr == NULL ? NULL : &(*entry_ptr)->value;
+static bool have_same_hashes(HM172Map *map, HM172Map *other_map) {
+    if (map->hash_n_function != NULL)
+        return map->hash_n_function == other_map->hash_n_function && map->hash_seed == other_map->hash_seed;
+    return other_map->hash_n_function == NULL && map->hash_function == other_map->hash_function;
 }
 
+/*
+ * Moves the key copies of the inserted entries out of the source entries if move_keys is true,
+ * leaving the source entries with empty inline keys
+ * Only the failures of this merge stop it, not the status the destination had before
+ */
+static void merge(HM172Map *destination, HM172Map *source, combine_function_t combine, bool move_keys) {
+    destination->modification_count++;
+    reserve(destination, destination->size + source->size);
+    bool reuses_hashes = have_same_hashes(destination, source);
+    HM172EntryIterator iterator;
+    hm172_init_entry_iterator(&iterator, source);
+    for (HM172Entry *entry; (entry = source->engine->next_entry(&iterator)) != NULL;) {
+        HM172ConstKey key = hm172_entry_key(entry);
+        // the entry keys are '\0'-terminated, so hashing them can't fail
+        HM172Hash hash = reuses_hashes ? entry->hash
+                                       : hash_terminated_key(destination, (HM172Key) key, entry->key_length);
+        bool inserted;
+        HM172Entry *merged = destination->engine->find_or_insert(destination, key, entry->key_length, hash, &inserted);
+        if (merged == NULL) return;
+        if (!inserted) {
+            merged->value = combine == NULL ? entry->value : combine(merged->value, entry->value);
+            continue;
+        }
+        if (move_keys && !hm172_is_key_inline(entry->key_length)) {
+            merged->key = entry->key;
+            merged->key_length = entry->key_length;
+            entry->key_length = 0;
+        } else if (!hm172_set_entry_key(destination, merged, key, entry->key_length)) {
+            destination->engine->undo_insert(destination, merged);
+            destination->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "key copy"};
+            return;
+        }
+        merged->value = entry->value;
+        destination->size++;
+#ifdef HM172_STATS
+        destination->counters.key_bytes += get_key_copy_size(merged->key_length);
+#endif
+        if (destination->threshold >= 0
+            && (float) (destination->size + destination->deleted_count) > destination->threshold)
+            grow(destination);
+    }
+}
+
+void hm172_merge(HM172Map *destination, HM172Map *source, combine_function_t combine) {
+    merge(destination, source, combine, false);
+}
+
+static bool have_same_allocator(const HM172Map *map, const HM172Map *other_map) {
+    return map->allocator.alloc == other_map->allocator.alloc && map->allocator.free == other_map->allocator.free
+           && map->allocator.context == other_map->allocator.context;
+}
+
+/*
+ * Returns whether the map is a mapped or frozen table, the keys of which belong to the table
+ */
+static bool is_read_only(const HM172Map *map) {
+    return map->engine == &hm172_mapped_engine || map->engine == &hm172_frozen_engine;
+}
+
+/*
+ * Keys can only be moved between the maps that allocate them one by one with the same allocator
+ */
+void hm172_merge_and_free(HM172Map *destination, HM172Map *source, combine_function_t combine) {
+    merge(destination, source, combine, !destination->uses_arena && !source->uses_arena
+                                        && have_same_allocator(destination, source) && !is_read_only(source));
+    hm172_free(source);
+}
+
+/*
+ * Clearing a read-only table promotes it to an empty one, the table is kept if the promotion fails
+ */
 void hm172_clear(HM172Map *map) {
     map->modification_count++;
+    if (map->uses_arena) {
+        map->engine->clear(map, NULL);
+        hm172_arena_reset(&map->arena);
+    } else map->engine->clear(map, free_key);
+    if (is_read_only(map)) return;
     map->size = 0;
-    for (size_t i = 0; i < map->capacity; i++) {
-        HM172Entry *entry = map->table[i];
-        if (entry != NULL) {
-            map->table[i] = NULL;
-            do {
-                free(entry->key);
-                HM172Entry *next = entry->next;
-                free(entry);
-                entry = next;
-            } while (entry != NULL);
-        }
-    }
+#ifdef HM172_STATS
+    map->counters.key_bytes = 0;
+#endif
 }
 
+/*
+ * The keys of arena maps and read-only tables aren't freed one by one, so they are destroyed without clearing
+ */
 void hm172_free(HM172Map *map) {
     if (map != NULL) {
-        hm172_clear(map);
-        free(map->table);
-        free(map);
+        if (!map->uses_arena && !is_read_only(map)) hm172_clear(map);
+        map->engine->destroy(map);
+        if (map->uses_arena) hm172_arena_free(&map->arena);
+        hm172_deallocate(map, map, sizeof(HM172Map));
     }
 }
 
+bool hm172_promote(HM172Map *map, const engine_t *engine, bool keep_entries) {
+    HM172Map promoted = *map;
+    promoted.engine = engine;
+    promoted.size = 0;
+    promoted.deleted_count = 0;
+    promoted.old_table = NULL;
+    size_t capacity = !keep_entries ? engine->min_capacity
+                      : map->load_factor >= 0 ? get_fitting_capacity(map, engine, map->size)
+                      : capacity_to_valid_capacity(engine, map->capacity);
+    if (!engine->init(&promoted, capacity)) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "promoted table"};
+        return false;
+    }
+    HM172EntryIterator iterator;
+    if (keep_entries) hm172_init_entry_iterator(&iterator, map);
+    for (HM172Entry *entry; keep_entries && (entry = map->engine->next_entry(&iterator)) != NULL;) {
+        bool inserted;
+        HM172ConstKey key = hm172_entry_key(entry);
+        HM172Entry *copy = engine->find_or_insert(&promoted, key, entry->key_length, entry->hash, &inserted);
+        if (copy == NULL || !hm172_set_entry_key(&promoted, copy, key, entry->key_length)) {
+            if (copy != NULL) engine->undo_insert(&promoted, copy);
+            // the keys already copied to the arena stay there until the map is cleared
+            engine->clear(&promoted, promoted.uses_arena ? NULL : free_key);
+            engine->destroy(&promoted);
+            map->arena = promoted.arena;
+            map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "promoted map"};
+            return false;
+        }
+        copy->value = entry->value;
+        promoted.size++;
+    }
+    map->engine->destroy(map);
+    *map = promoted;
+    map->modification_count++;
+    hm172_update_threshold(map);
+    return true;
+}
+
 HM172Status hm172_get_status(HM172Map *map) {
     return map->status;
 }
 
 void hm172_fprint_stats(HM172Map *map, FILE *stream) {
-    size_t chain_count = 0;
-    for (size_t i = 0; i < map->capacity; i++)
-        if (map->table[i] != NULL) chain_count++;
     if (fprintf(stream, "============\n"
                         "HM172Map stats:\n"
                         "capacity: %zu\n"
                         "threshold: %0.f\n"
-                        "size: %zu\n"
-                        "chain count: %zu\n"
-                        "average chain length: %f\n"
-                        "modification count: %u\n"
-                        "============\n",
-                map->capacity, map->threshold, map->size, chain_count,
-                map->size / (float) chain_count, map->modification_count) < 0)
+                        "size: %zu\n",
+                map->capacity, map->threshold, map->size) < 0
+        || map->engine->fprint_stats(map, stream) < 0
+        || fprintf(stream, "modification count: %u\n"
+                           "============\n",
+                   map->modification_count) < 0)
+        map->status = (HM172Status) {PRINT_ERROR, "stats"};
+}
+
+HM172Stats hm172_get_stats(HM172Map *map) {
+    size_t table_capacity = map->capacity + (map->old_table != NULL ? map->old_capacity : 0);
+    HM172Stats stats = {
+            .size = map->size,
+            .capacity = map->capacity,
+            .table_bytes = table_capacity * map->engine->slot_size,
+            .entry_bytes = map->size * map->engine->node_size
+    };
+#ifdef HM172_STATS
+    stats.counters_enabled = true;
+    stats.lookup_count = map->counters.lookup_count;
+    stats.hit_count = map->counters.hit_count;
+    stats.miss_count = map->counters.lookup_count - map->counters.hit_count;
+    stats.probe_count = map->counters.probe_count;
+    memcpy(stats.probe_histogram, map->counters.probe_histogram, sizeof(stats.probe_histogram));
+    stats.resize_count = map->counters.resize_count;
+    stats.resize_seconds = (double) map->counters.resize_nanoseconds / 1e9;
+    stats.key_bytes = map->counters.key_bytes;
+#endif
+    return stats;
+}
+
+void hm172_fprint_stats_json(HM172Map *map, FILE *stream) {
+    HM172Stats stats = hm172_get_stats(map);
+    bool failed = fprintf(stream, "{\"counters_enabled\":%s,\"size\":%zu,\"capacity\":%zu,"
+                                  "\"lookup_count\":%" PRIu64 ",\"hit_count\":%" PRIu64 ",\"miss_count\":%" PRIu64 ","
+                                  "\"probe_count\":%" PRIu64 ",\"probe_histogram\":[",
+                          stats.counters_enabled ? "true" : "false", stats.size, stats.capacity,
+                          stats.lookup_count, stats.hit_count, stats.miss_count, stats.probe_count) < 0;
+    for (size_t i = 0; i < HM172_PROBE_HISTOGRAM_SIZE && !failed; i++)
+        failed = fprintf(stream, i == 0 ? "%" PRIu64 : ",%" PRIu64, stats.probe_histogram[i]) < 0;
+    if (failed
+        || fprintf(stream, "],\"resize_count\":%" PRIu64 ",\"resize_seconds\":%.9f,"
+                           "\"table_bytes\":%zu,\"entry_bytes\":%zu,\"key_bytes\":%zu}\n",
+                   stats.resize_count, stats.resize_seconds, stats.table_bytes, stats.entry_bytes, stats.key_bytes) < 0)
         map->status = (HM172Status) {PRINT_ERROR, "stats"};
 }
 
@@ -213,70 +622,131 @@ bool hm172_log_and_free_on_error(HM172Map *map) {
     return has_error;
 }
 
-struct entry_iterator_t {
-    HM172Map *map;
-    unsigned expected_modification_count;
-    size_t next_index;
-    HM172Entry *next_entry;
-};
-
-static void advance_next_index(HM172EntryIterator *entry) {
-    while (entry->next_index < entry->map->capacity &&
-           (entry->next_entry = entry->map->table[entry->next_index++]) == NULL) {}
-}
-
 HM172Entry *hm172_next_entry(HM172EntryIterator *iterator) {
     if (iterator->map->modification_count != iterator->expected_modification_count) {
         iterator->map->status = (HM172Status) {STATUS_CONCURRENT_MODIFICATION, "entry iterator"};
         return NULL;
     }
-    if (iterator->next_entry == NULL) return NULL;
-    HM172Entry *current = iterator->next_entry;
-    if ((iterator->next_entry = iterator->next_entry->next) == NULL)
-        advance_next_index(iterator);
-    return current;
+    return iterator->map->engine->next_entry(iterator);
 }
 
 void hm172_free_entry_iterator(HM172EntryIterator *iterator) {
-    free(iterator);
+    if (iterator == NULL) return;
+    iterator->map->iterator_count--;
+    hm172_deallocate(iterator->map, iterator, sizeof(HM172EntryIterator));
+}
+
+void hm172_init_entry_iterator(HM172EntryIterator *iterator, HM172Map *map) {
+    hm172_init_entry_range_iterator(iterator, map, 0, map->engine->get_iteration_length(map));
+}
+
+void hm172_init_entry_range_iterator(HM172EntryIterator *iterator, HM172Map *map, size_t begin, size_t end) {
+    iterator->map = map;
+    iterator->expected_modification_count = map->modification_count;
+    iterator->next_index = begin;
+    iterator->end_index = end;
+    iterator->next_node = NULL;
+    map->engine->start_iteration(iterator);
 }
 
 HM172EntryIterator *hm172_get_entry_iterator(HM172Map *map) {
-    HM172EntryIterator *iterator = malloc(sizeof(HM172EntryIterator));
+    HM172EntryIterator *iterator = hm172_allocate(map, sizeof(HM172EntryIterator));
     if (iterator == NULL) {
         map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "entry iterator"};
         return NULL;
     }
-    iterator->map = map;
-    iterator->expected_modification_count = map->modification_count;
-    iterator->next_index = 0;
-    iterator->next_entry = NULL;
-    advance_next_index(iterator);
+    map->iterator_count++;
+    hm172_init_entry_iterator(iterator, map);
     return iterator;
 }
 
-static size_t capacity_to_valid_capacity(size_t capacity) {
-    if (capacity > MAX_CAPACITY) capacity = MAX_CAPACITY;
-    size_t valid_capacity = 1;
-    while (valid_capacity < capacity) valid_capacity <<= 1u;
-    if (valid_capacity > MAX_CAPACITY) valid_capacity >>= 1u;
-    return valid_capacity;
+/*
+ * The positions the iterator hasn't reached yet are halved, the entry the iterator is positioned at stays with it
+ */
+HM172EntryIterator *hm172_split_entry_iterator(HM172EntryIterator *iterator) {
+    HM172Map *map = iterator->map;
+    if (map->modification_count != iterator->expected_modification_count) {
+        map->status = (HM172Status) {STATUS_CONCURRENT_MODIFICATION, "entry iterator"};
+        return NULL;
+    }
+    if (iterator->end_index - iterator->next_index < 2) return NULL;
+    HM172EntryIterator *split = hm172_allocate(map, sizeof(HM172EntryIterator));
+    if (split == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "entry iterator"};
+        return NULL;
+    }
+    *split = *iterator;
+    split->next_index = iterator->next_index + (iterator->end_index - iterator->next_index) / 2;
+    split->next_node = NULL;
+    iterator->end_index = split->next_index;
+    map->iterator_count++;
+    map->engine->start_iteration(split);
+    return split;
 }
 
-HM172Map *hm172_new_map(size_t capacity, float load_factor, hash_function_t hash_function) {
-    HM172Map *map = malloc(sizeof(HM172Map));
-    if (map == NULL) return NULL;
-    map->capacity = capacity_to_valid_capacity(capacity);
-    map->table = calloc(map->capacity, sizeof(HM172Entry *));
-    if (map->table == NULL) {
-        free(map);
-        return NULL;
+const engine_t *hm172_get_engine(HM172Engine engine) {
+    switch (engine) {
+        case ENGINE_OPEN_ADDRESSING: return &hm172_open_addressing_engine;
+        case ENGINE_DENSE: return &hm172_dense_engine;
+        case ENGINE_CHAINED:
+        default: return &hm172_chained_engine;
+    }
+}
+
+static float get_effective_load_factor(const engine_t *engine, float load_factor) {
+    if (engine->max_load_factor >= 0 && (load_factor < 0 || load_factor > engine->max_load_factor))
+        return engine->max_load_factor;
+    return load_factor < 0 ? -1 : load_factor;
+}
+
+void hm172_init_map_fields(HM172Map *map, const HM172MapOptions *options, const engine_t *engine) {
+    map->hash_function = options->hash_function;
+    map->hash_n_function = options->hash_n_function;
+    map->hash_seed = options->hash_seed;
+    if (options->random_hash_seed) {
+        map->hash_seed = hm172_random_seed();
+        if (map->hash_n_function == NULL) map->hash_n_function = hm172_mum_hash;
     }
-    map->hash_function = hash_function;
+    if (map->hash_n_function == NULL && map->hash_function == hm172_polynomial_hash)
+        map->hash_n_function = hm172_polynomial_hash_n;
+    map->index_seed = 0;
     map->status = (HM172Status) {STATUS_OK, NULL};
     map->modification_count = 0;
     map->size = 0;
-    map->load_factor = load_factor < 0 ? -1 : load_factor;
-    update_threshold(map);
+    map->load_factor = get_effective_load_factor(engine, options->load_factor);
+    map->shrink_load_factor = options->shrink_load_factor;
+    // hysteresis: a shrunk table must not be refilled up to the threshold by a few puts
+    if (map->shrink_load_factor > map->load_factor / 4) map->shrink_load_factor = map->load_factor / 4;
+    map->deleted_count = 0;
+    map->uses_arena = options->use_arena;
+    map->old_table = NULL;
+    map->resize_step = options->resize_step;
+    map->iterator_count = 0;
+#ifdef HM172_STATS
+    map->counters = (counters_t) {0};
+#endif
+    map->allocator = *hm172_get_options_allocator(options);
+    hm172_arena_init(&map->arena, &map->allocator);
+}
+
+HM172Map *hm172_new_map_with_options(const HM172MapOptions *options) {
+    const HM172Allocator *allocator = hm172_get_options_allocator(options);
+    HM172Map *map = allocator->alloc(allocator->context, sizeof(HM172Map));
+    if (map == NULL) return NULL;
+    map->allocator = *allocator; // the table is allocated before the other fields are set
+    map->engine = hm172_get_engine(options->engine);
+    if (!map->engine->init(map, capacity_to_valid_capacity(map->engine, options->capacity))) {
+        hm172_deallocate(map, map, sizeof(HM172Map));
+        return NULL;
+    }
+    hm172_init_map_fields(map, options, map->engine);
+    hm172_update_threshold(map);
     return map;
 }
+
+HM172Map *hm172_new_map(size_t capacity, float load_factor, hash_function_t hash_function) {
+    HM172MapOptions options = {
+            .engine = ENGINE_CHAINED, .capacity = capacity, .load_factor = load_factor, .hash_function = hash_function
+    };
+    return hm172_new_map_with_options(&options);
+}
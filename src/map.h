@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include "hash.h"
 #include "status.h"
+#include "allocator.h"
 
 typedef char *HM172Key;
 typedef const char *HM172ConstKey;
@@ -11,12 +12,99 @@ typedef int HM172Value;
 
 typedef HM172Hash (*hash_function_t)(HM172Key key);
 
+/*
+ * Hash function of a key of the given length, which isn't necessarily followed by '\0'
+ * Different seeds should give independent hash functions
+ */
+typedef HM172Hash (*hash_n_function_t)(HM172ConstKey key, size_t length, uint64_t seed);
+
+/*
+ * Table layouts the map can be built on:
+ *  - ENGINE_CHAINED: array of entry chains, entries never move while they are in the map
+ *  - ENGINE_OPEN_ADDRESSING: entries are stored inline in the table, which is probed a group of slots at a time
+ *    using a byte of hash fingerprint per slot, so lookups touch fewer cache lines and entries take less memory,
+ *    but entries move on resize, so all entry and value pointers become invalid after each direct map modification
+ *  - ENGINE_DENSE: entries are stored in an array in insertion order and the table only holds their positions,
+ *    so iteration is a scan of size entries in insertion order rather than of the whole table,
+ *    entries move like the ones of ENGINE_OPEN_ADDRESSING and resizes are never incremental
+ */
+typedef enum {
+    ENGINE_CHAINED,
+    ENGINE_OPEN_ADDRESSING,
+    ENGINE_DENSE
+} HM172Engine;
+
+typedef struct {
+    HM172Engine engine;
+    size_t capacity;
+    float load_factor; // ENGINE_OPEN_ADDRESSING and ENGINE_DENSE replace negative ones and the ones above 0.875 with 0.875
+    hash_function_t hash_function;
+    /*
+     * Length-aware hash function used instead of hash_function if not NULL, must be set to hash (ptr, len) keys
+     * that aren't followed by '\0' without copying them; it is set automatically if hash_function is hm172_polynomial_hash
+     */
+    hash_n_function_t hash_n_function;
+    uint64_t hash_seed; // passed to hash_n_function
+    /*
+     * If true, hash_seed is replaced with a random one drawn for the map, and hash_n_function defaults
+     * to hm172_mum_hash instead of hash_function, so that the keys colliding in the map can't be precomputed
+     * The seed is returned by hm172_get_hash_seed, e.g. to open a snapshot of the map with it
+     * Seeding doesn't change the collisions of hm172_polynomial_hash_n, as the seed is only added to its hashes
+     */
+    bool random_hash_seed;
+    /*
+     * If true, entries and key copies are bump-allocated from large slabs owned by the map,
+     * which are released all at once by hm172_clear and hm172_free
+     */
+    bool use_arena;
+    /*
+     * If not 0, resizing is incremental: the old and the new tables are kept together and each put and get moves
+     * the entries of up to resize_step old buckets (groups of slots for ENGINE_OPEN_ADDRESSING) to the new table,
+     * so that no single call rehashes the whole table, and so does each removal
+     * Gets and removals don't move entries while there are not freed iterators of the map,
+     * and for ENGINE_OPEN_ADDRESSING, the entries of which move, gets and get_or_puts of present keys never do,
+     * so that the pointers they return stay valid until the next direct map modification
+     * A resize that isn't finished when the next one is due is finished at once, which never happens
+     * if resize_step is at least 1 / load_factor (for ENGINE_OPEN_ADDRESSING at least 1 / (16 * load_factor))
+     */
+    size_t resize_step;
+    /*
+     * If positive, a removal that leaves fewer than capacity * shrink_load_factor entries halves the capacity
+     * It is reduced to load_factor / 4 if greater, so that a few puts after a shrink can't grow the table back
+     */
+    float shrink_load_factor;
+    /*
+     * Allocator of the memory the map keeps, hm172_malloc_allocator if NULL, copied to the map
+     * Keys are only moved by hm172_merge_and_free between maps with the same allocator functions and context
+     */
+    const HM172Allocator *allocator;
+} HM172MapOptions;
+
+/*
+ * Function that returns a new value computed from the value and the caller-supplied context
+ */
+typedef HM172Value (*update_function_t)(HM172Value value, void *context);
+
+/*
+ * Function that returns the value of a key mapped by both merged maps from its destination and source values
+ */
+typedef HM172Value (*combine_function_t)(HM172Value value, HM172Value other_value);
+
 typedef struct map_t HM172Map;
 typedef struct entry_t HM172Entry;
 typedef struct entry_iterator_t HM172EntryIterator;
 
+/*
+ * Returns the key of the entry, which is always followed by '\0'
+ * Short keys are stored in the entry itself, so the key is valid as long as the entry pointer is
+ */
 HM172ConstKey hm172_get_entry_key(HM172Entry *entry);
 
+/*
+ * Returns the key length, which excludes the trailing '\0'
+ */
+size_t hm172_get_entry_key_length(HM172Entry *entry);
+
 HM172Value hm172_get_entry_value(HM172Entry *entry);
 
 void hm172_set_entry_value(HM172Entry *entry, HM172Value value);
@@ -30,6 +118,9 @@ void hm172_set_entry_value(HM172Entry *entry, HM172Value value);
  */
 HM172Entry *hm172_next_entry(HM172EntryIterator *iterator);
 
+/*
+ * Iterators must be freed before their map
+ */
 void hm172_free_entry_iterator(HM172EntryIterator *iterator);
 
 /*
@@ -39,10 +130,20 @@ void hm172_free_entry_iterator(HM172EntryIterator *iterator);
  */
 HM172Map *hm172_new_map(size_t capacity, float load_factor, hash_function_t hash_function);
 
+/*
+ * Returns new HM172Map instance built on the engine specified in options
+ * hm172_new_map(capacity, load_factor, hash_function) is equivalent to passing {ENGINE_CHAINED, capacity, load_factor, hash_function}
+ * Options omitted from a designated initializer are zero-initialized, which disables the corresponding features
+ * If sufficient amount of memory can't be allocated, NULL is returned
+ */
+HM172Map *hm172_new_map_with_options(const HM172MapOptions *options);
+
 size_t hm172_size(HM172Map *map);
 
 /*
  * Removes all of the mappings from the map, makes all entries and value pointers invalid
+ * Clearing a mapped or frozen map promotes it to an empty normal one: if sufficient amount of memory
+ * can't be allocated, the map state type is set to OUT_OF_MEMORY and the map keeps its mappings
  */
 void hm172_clear(HM172Map *map);
 
@@ -63,19 +164,196 @@ void hm172_put(HM172Map *map, HM172Key key, HM172Value value);
  */
 HM172Value *hm172_get(HM172Map *map, HM172Key key);
 
+/*
+ * Length-aware versions of hm172_put and hm172_get, the key doesn't need to be followed by '\0' and can contain '\0'
+ * The key is copied together with an appended '\0', so that hm172_get_entry_key returns a C string for keys without '\0'
+ * If the map has no hash_n_function, the key is copied to a temporary '\0'-terminated buffer to be hashed,
+ * and if memory for the buffer can't be allocated, the map state type is set to OUT_OF_MEMORY
+ */
+void hm172_put_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value);
+
+HM172Value *hm172_get_n(HM172Map *map, HM172ConstKey key, size_t length);
+
+/*
+ * Returns the hash of the key the map uses, so it can be computed once and passed to the *_hashed functions
+ * of each map that uses the same hash function
+ * If memory for a temporary buffer can't be allocated, the map state type is set to OUT_OF_MEMORY
+ */
+HM172Hash hm172_hash_key(HM172Map *map, HM172ConstKey key, size_t length);
+
+/*
+ * Returns the seed the map passes to its hash_n_function
+ */
+uint64_t hm172_get_hash_seed(HM172Map *map);
+
+/*
+ * Versions of hm172_put_n and hm172_get_n that take the hash of the key instead of computing it
+ * If the hash differs from the one returned by hm172_hash_key, the BEHAVIOUR is UNDEFINED
+ */
+void hm172_put_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash, HM172Value value);
+
+HM172Value *hm172_get_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash);
+
+/*
+ * Returns pointer to the value to which the specified key is mapped, mapping the key to the value first
+ * if this map contains no mapping for the key, with a single hash computation and a single table probe
+ * If inserted isn't NULL, it is set to whether a new mapping was created
+ * A new mapping is a direct map modification, while an existing one isn't modified
+ * The returned pointer has the same properties as the one returned by hm172_get
+ * If the key is NULL the BEHAVIOUR is UNDEFINED
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY and NULL is returned
+ */
+HM172Value *hm172_get_or_put(HM172Map *map, HM172Key key, HM172Value value, bool *inserted);
+
+HM172Value *hm172_get_or_put_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value, bool *inserted);
+
+HM172Value *hm172_get_or_put_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash,
+                                    HM172Value value, bool *inserted);
+
+/*
+ * Replaces the value to which the key is mapped with the result of update_function applied to it and the context,
+ * mapping the key to initial_value first if this map contains no mapping for the key
+ * E.g. counting occurrences is hm172_update(map, key, 0, increment, NULL), where increment returns value + 1
+ * Returns pointer to the updated value, which has the same properties as the one returned by hm172_get_or_put
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY and NULL is returned
+ */
+HM172Value *hm172_update(HM172Map *map, HM172Key key, HM172Value initial_value,
+                         update_function_t update_function, void *context);
+
+HM172Value *hm172_update_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value initial_value,
+                           update_function_t update_function, void *context);
+
+/*
+ * Puts all the mappings of the source map to the destination map, a key mapped by both maps is mapped
+ * to combine(destination value, source value), or to the source value if combine is NULL
+ * The destination table is resized once to hold all the entries of both maps, and the hashes stored
+ * in the source entries are reused if both maps have the same hash function and seed
+ * The maps must be different, the source map isn't changed
+ * If sufficient amount of memory can't be allocated, the destination map state type is set to OUT_OF_MEMORY
+ * and only a part of the mappings is merged
+ */
+void hm172_merge(HM172Map *destination, HM172Map *source, combine_function_t combine);
+
+/*
+ * hm172_merge that consumes the source map: the source key copies are moved to the destination map
+ * rather than copied if neither map uses an arena, and the source map is freed, even if the merge fails
+ */
+void hm172_merge_and_free(HM172Map *destination, HM172Map *source, combine_function_t combine);
+
+/*
+ * Sets out_values[i] to the result of hm172_get for keys[i], for each i below n
+ * Faster than separate lookups for maps that don't fit in the cache: the keys are hashed in windows and the memory
+ * each lookup needs is prefetched for the whole window before any of the keys is looked up
+ * The whole batch takes at most one incremental resize step, so all the returned pointers are valid at once
+ */
+void hm172_get_batch(HM172Map *map, const HM172ConstKey *keys, size_t n, HM172Value **out_values);
+
+/*
+ * Same as hm172_get_batch for keys of the given lengths
+ */
+void hm172_get_batch_n(HM172Map *map, const HM172ConstKey *keys, const size_t *lengths, size_t n,
+                       HM172Value **out_values);
+
+/*
+ * Makes the map associate values[i] with keys[i], for each i below n, in order, prefetching like hm172_get_batch
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY
+ */
+void hm172_put_batch(HM172Map *map, const HM172ConstKey *keys, const HM172Value *values, size_t n);
+
+void hm172_put_batch_n(HM172Map *map, const HM172ConstKey *keys, const size_t *lengths, const HM172Value *values,
+                       size_t n);
+
+/*
+ * Removes the mapping for the key if this map contains one, setting *value to the removed value if value isn't NULL
+ * Returns whether there was a mapping
+ * The key copy is freed, unless the map uses an arena, which releases the memory only on hm172_shrink_to_fit,
+ * hm172_clear and hm172_free
+ * The capacity is halved if the size drops below the shrink threshold, see shrink_load_factor of HM172MapOptions
+ * If the table can't be reallocated, the map state type is set to OUT_OF_MEMORY and the map keeps the capacity
+ */
+bool hm172_remove(HM172Map *map, HM172Key key, HM172Value *value);
+
+bool hm172_remove_n(HM172Map *map, HM172ConstKey key, size_t length, HM172Value *value);
+
+bool hm172_remove_hashed(HM172Map *map, HM172ConstKey key, size_t length, HM172Hash hash, HM172Value *value);
+
+/*
+ * Reallocates the table with the smallest capacity that holds the entries below the load factor, finishing
+ * an incremental resize and dropping the deleted slots of ENGINE_OPEN_ADDRESSING
+ * If the map uses an arena, the entries and the keys are moved to a new one, releasing the memory of removed entries
+ * Pointers to the values and the keys of the entries are invalidated
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY
+ */
+void hm172_shrink_to_fit(HM172Map *map);
+
+/*
+ * Resizes the table at once to the smallest capacity that holds size entries below the load factor,
+ * so that putting up to size entries doesn't resize it again, e.g. to the estimate of a HyperLogLog sketch
+ * of the keys before a bulk load, see hyperloglog.h
+ * Does nothing if the table is large enough or resizing is disabled
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY
+ */
+void hm172_reserve(HM172Map *map, size_t size);
+
 /*
  * Returns the iterator that can be used to iterate over all map entries by passing it to hm172_next_entry function
- * Iteration order is unspecified
+ * Iteration order is unspecified, except for ENGINE_DENSE maps, which are iterated over in insertion order
  * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY and NULL is returned
  */
 HM172EntryIterator *hm172_get_entry_iterator(HM172Map *map);
 
+/*
+ * Splits off the second half of the entries the iterator hasn't returned yet to a new iterator, which must be freed too
+ * The halves are ranges of table positions, e.g. buckets, so they are balanced by positions rather than entries
+ * While the map isn't modified, the iterators can be used by different threads to scan the map in parallel,
+ * but they must be created and freed by the thread that owns the map
+ * Returns NULL if there's only one position left to split, if the map has been directly modified after
+ * the iterator creation, setting the map state type to CONCURRENT_MODIFICATION, or if sufficient amount
+ * of memory can't be allocated, setting the map state type to OUT_OF_MEMORY
+ */
+HM172EntryIterator *hm172_split_entry_iterator(HM172EntryIterator *iterator);
+
 /*
  * Prints map statistics to the specified stream
+ * Scans the whole table, see hm172_get_stats for the statistics that are available in constant time
  * If a writing error occurs, the map status type is set to PRINT_ERROR
  */
 void hm172_fprint_stats(HM172Map *map, FILE *stream);
 
+#define HM172_PROBE_HISTOGRAM_SIZE 16
+
+/*
+ * Counters are only maintained if the map is compiled with HM172_STATS defined (the HM172_STATS CMake option),
+ * otherwise they are compiled out and zero
+ * A probe is a compared chain node for ENGINE_CHAINED and a probed group of slots for ENGINE_OPEN_ADDRESSING
+ */
+typedef struct {
+    bool counters_enabled;
+    size_t size;
+    size_t capacity;
+    uint64_t lookup_count; // gets, puts and get_or_puts, whether they have found the key or not
+    uint64_t hit_count;
+    uint64_t miss_count;
+    uint64_t probe_count; // summed over lookups
+    uint64_t probe_histogram[HM172_PROBE_HISTOGRAM_SIZE]; // lookups by probe count, the last one counts longer ones too
+    uint64_t resize_count;
+    double resize_seconds; // including the incremental migration steps
+    size_t table_bytes; // including the old table while a resize is in progress
+    size_t entry_bytes; // separately allocated entry nodes, 0 for the engines storing entries in the table
+    size_t key_bytes; // copies of the keys too long to be stored in the entries including '\0', counted only with HM172_STATS
+} HM172Stats;
+
+/*
+ * Returns the map statistics in constant time, so it can be called on a map in use as often as needed
+ */
+HM172Stats hm172_get_stats(HM172Map *map);
+
+/*
+ * Prints the result of hm172_get_stats as a single line JSON object with the same field names
+ * If a writing error occurs, the map status type is set to PRINT_ERROR
+ */
+void hm172_fprint_stats_json(HM172Map *map, FILE *stream);
+
 HM172Status hm172_get_status(HM172Map *map);
 
 bool hm172_is_ok(HM172Map *map);
@@ -0,0 +1,301 @@
+#ifndef HASHMAP_172_MAP_ENGINE_H
+#define HASHMAP_172_MAP_ENGINE_H
+
+/*
+ * Internal definitions shared by map.c and the table engines, not a part of the public API
+ */
+
+#include <string.h>
+#include "map.h"
+#include "arena.h"
+
+/*
+ * For all non-negative integers x < MAX_CAPACITY:
+ *  - 2x must be within the range of size_t type
+ *  - x must be within the range of HM172Hash type
+ */
+#define MAX_CAPACITY ((size_t) 1 + ((HASH_MAX < SIZE_MAX / 2) ? HASH_MAX : (SIZE_MAX / 2)))
+
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void) (address))
+#endif
+
+/*
+ * Batched operations prefetch the memory a lookup depends on in this many stages, each of which needs
+ * the memory prefetched by the previous one to be loaded
+ */
+#define PREFETCH_STAGE_COUNT 3
+
+/*
+ * Keys shorter than HM172_INLINE_KEY_SIZE are stored in the entry together with their '\0',
+ * which saves an allocation per entry and a cache miss per comparison, longer keys are copied separately
+ */
+#define HM172_INLINE_KEY_SIZE 16
+
+struct entry_t {
+    union {
+        HM172Key key; // copy of a key that isn't inline
+        char inline_key[HM172_INLINE_KEY_SIZE];
+    }; // always followed by '\0', which isn't counted in the key length
+    size_t key_length;
+    HM172Hash hash;
+    HM172Value value;
+};
+
+static inline bool hm172_is_key_inline(size_t key_length) {
+    return key_length < HM172_INLINE_KEY_SIZE;
+}
+
+static inline HM172ConstKey hm172_entry_key(const HM172Entry *entry) {
+    return hm172_is_key_inline(entry->key_length) ? entry->inline_key : entry->key;
+}
+
+static inline bool hm172_entry_has_key(const HM172Entry *entry, HM172ConstKey key, size_t key_length) {
+    return entry->key_length == key_length && memcmp(hm172_entry_key(entry), key, key_length) == 0;
+}
+
+typedef struct {
+    /*
+     * Allocates an empty table of the given capacity, returns false if memory can't be allocated
+     * The capacity is already valid for the engine
+     */
+    bool (*init)(HM172Map *map, size_t capacity);
+
+    /*
+     * Frees the table of the map and the old table if a resize is in progress, the map is already cleared
+     * unless it uses an arena or is read-only, so that its keys aren't freed one by one
+     */
+    void (*destroy)(HM172Map *map);
+
+    /*
+     * Allocates a new table of the given valid capacity and makes the current one the old table
+     * The new capacity can be any valid one: a multiple of the current one when the map grows or is reserved,
+     * a smaller one when it shrinks, or the same one when an engine with deleted slots is rehashed
+     * There must be no resize in progress
+     * If memory can't be allocated, the map status is set and the current table is kept
+     */
+    void (*start_resize)(HM172Map *map, size_t new_capacity);
+
+    /*
+     * Moves the entries of up to bucket_count old table buckets to the new table
+     * and frees the old table once all of them are moved
+     */
+    void (*migrate)(HM172Map *map, size_t bucket_count);
+
+    /*
+     * Returns the entry with the given key and hash or NULL if there's no such entry
+     * While a resize is in progress, both tables are searched
+     */
+    HM172Entry *(*find)(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash);
+
+    /*
+     * Prefetches the memory that a lookup of the hash reads at the given stage, from 0 to PREFETCH_STAGE_COUNT - 1
+     * Stage i may read the memory prefetched by stage i - 1, e.g. a bucket to prefetch the entry it points to
+     */
+    void (*prefetch)(HM172Map *map, HM172Hash hash, unsigned stage);
+
+    /*
+     * Returns the entry with the given key and hash, or inserts a new one with the hash if there's no such entry
+     * Sets *inserted to whether the entry is new, the key and the value of a new entry must be filled in by the caller
+     * The key is looked up and the insertion position is found in a single probe, new entries always go to the new table
+     * Returns NULL and sets the map status if memory can't be allocated
+     */
+    HM172Entry *(*find_or_insert)(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, bool *inserted);
+
+    /*
+     * Removes the entry just returned by find_or_insert as a new one, before any other map modification
+     */
+    void (*undo_insert)(HM172Map *map, HM172Entry *entry);
+
+    /*
+     * Removes the entry with the given key and hash and copies it to *removed, returns false if there's no such entry
+     * The entry node is freed, but its key isn't
+     */
+    bool (*remove_entry)(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, HM172Entry *removed);
+
+    /*
+     * Copies the entry nodes of a map using an arena to the given arena, NULL for the engines not allocating entry nodes
+     * The arena must have enough memory reserved, and there must be no resize in progress
+     */
+    void (*move_nodes)(HM172Map *map, HM172Arena *arena);
+
+    /*
+     * Calls free_key for each entry and removes all the entries keeping the capacity
+     * The old table is freed if a resize is in progress
+     * If free_key is NULL, the keys and the entry nodes belong to the map arena, so they aren't freed one by one
+     */
+    void (*clear)(HM172Map *map, void (*free_key)(HM172Map *map, HM172Entry *entry));
+
+    /*
+     * Returns the number of iteration positions, e.g. buckets, which an iterator can be limited to a range of
+     */
+    size_t (*get_iteration_length)(HM172Map *map);
+
+    /*
+     * Positions the iterator before the first entry at the positions from next_index to end_index
+     * While a resize is in progress, the entries of the old table are iterated over first
+     */
+    void (*start_iteration)(HM172EntryIterator *iterator);
+
+    /*
+     * Returns the entry the iterator is positioned at and advances it, or returns NULL if there are no entries left
+     */
+    HM172Entry *(*next_entry)(HM172EntryIterator *iterator);
+
+    /*
+     * Prints engine specific statistics lines, returns a negative number on error
+     */
+    int (*fprint_stats)(HM172Map *map, FILE *stream);
+
+    size_t min_capacity;
+    size_t slot_size; // table bytes per unit of capacity
+    size_t node_size; // bytes of an entry stored outside the table, 0 if entries are stored in the table
+    float max_load_factor; // the load factor used when the requested one is negative or greater than this one, ignored if negative
+} engine_t;
+
+extern const engine_t hm172_chained_engine;
+extern const engine_t hm172_open_addressing_engine;
+extern const engine_t hm172_dense_engine;
+extern const engine_t hm172_mapped_engine;
+extern const engine_t hm172_frozen_engine;
+
+#ifdef HM172_STATS
+typedef struct {
+    uint64_t lookup_count;
+    uint64_t hit_count;
+    uint64_t probe_count;
+    uint64_t probe_histogram[HM172_PROBE_HISTOGRAM_SIZE];
+    uint64_t resize_count;
+    uint64_t resize_nanoseconds;
+    size_t key_bytes;
+} counters_t;
+#endif
+
+struct map_t {
+    const engine_t *engine;
+    void *table; // engine specific
+    hash_function_t hash_function;
+    hash_n_function_t hash_n_function; // used instead of hash_function if not NULL
+    uint64_t hash_seed;
+    uint64_t index_seed; // engine specific: secret seed of the ENGINE_CHAINED chain indices, 0 until one is built
+    HM172Status status;
+    size_t capacity; // must be a power of 2, can't be 0
+    unsigned modification_count; // increments on each map update, makes outdated iterators fail fast
+    size_t size;
+    float threshold; // negative if resizing disabled
+    float load_factor; // negative if resizing disabled
+    float shrink_threshold; // negative if shrinking disabled
+    float shrink_load_factor; // not positive if shrinking disabled
+    size_t deleted_count; // engine specific: slots or entries of the current table holding deleted marks, counted by the threshold
+    bool uses_arena; // entry nodes and key copies are allocated from the arena
+    HM172Arena arena;
+    HM172Allocator allocator;
+    void *old_table; // not NULL while an incremental resize is in progress, engine specific
+    size_t old_capacity;
+    size_t migrated_bucket_count; // old table buckets with indices below it are empty
+    size_t resize_step; // 0 if resizing isn't incremental
+    unsigned iterator_count; // number of not freed iterators, lookups don't migrate buckets while it isn't 0
+#ifdef HM172_STATS
+    counters_t counters;
+#endif
+};
+
+struct entry_iterator_t {
+    HM172Map *map;
+    unsigned expected_modification_count;
+    size_t next_index;
+    size_t end_index; // the iteration positions from end_index on belong to other iterators
+    void *next_node; // engine specific
+};
+
+/*
+ * Counts a lookup that probed the given number of chain nodes or slot groups, compiled out without HM172_STATS
+ */
+static inline void hm172_record_lookup(HM172Map *map, size_t probe_count, bool hit) {
+#ifdef HM172_STATS
+    map->counters.lookup_count++;
+    map->counters.hit_count += hit;
+    map->counters.probe_count += probe_count;
+    map->counters.probe_histogram[probe_count < HM172_PROBE_HISTOGRAM_SIZE ? probe_count
+                                                                           : HM172_PROBE_HISTOGRAM_SIZE - 1]++;
+#else
+    (void) map;
+    (void) probe_count;
+    (void) hit;
+#endif
+}
+
+void hm172_update_threshold(HM172Map *map);
+
+/*
+ * Positions the iterator before the first entry of the map, without registering it as a not freed iterator
+ */
+void hm172_init_entry_iterator(HM172EntryIterator *iterator, HM172Map *map);
+
+/*
+ * Positions the iterator before the first entry at the iteration positions from begin to end
+ */
+void hm172_init_entry_range_iterator(HM172EntryIterator *iterator, HM172Map *map, size_t begin, size_t end);
+
+const engine_t *hm172_get_engine(HM172Engine engine);
+
+/*
+ * Sets the fields of a new map from the options, except the engine, the table, the capacity and the thresholds
+ * The load factor is limited by the given engine
+ */
+void hm172_init_map_fields(HM172Map *map, const HM172MapOptions *options, const engine_t *engine);
+
+/*
+ * Replaces the table of the map with a table of the engine holding copies of the entries, or an empty one
+ * if keep_entries is false, and destroys the old table
+ * Promotion is a modification, so the iterators created before it fail instead of reading the destroyed table
+ * Returns false and sets the map status if memory can't be allocated, the map is unchanged then
+ */
+bool hm172_promote(HM172Map *map, const engine_t *engine, bool keep_entries);
+
+/*
+ * Returns the engine a map served from a mapped snapshot is promoted to
+ */
+const engine_t *hm172_get_mapped_target_engine(HM172Map *map);
+
+/*
+ * Stores a '\0'-terminated copy of the key in the entry, allocating it for the map if the key isn't inline
+ * Returns false if memory can't be allocated
+ */
+bool hm172_set_entry_key(HM172Map *map, HM172Entry *entry, HM172ConstKey key, size_t length);
+
+/*
+ * Allocates memory for an entry node owned by the engine, returns NULL if memory can't be allocated
+ */
+void *hm172_alloc_node(HM172Map *map, size_t size);
+
+/*
+ * Frees an entry node of the given size, unless it belongs to the map arena
+ */
+void hm172_free_node(HM172Map *map, void *node, size_t size);
+
+/*
+ * Allocate and free the memory the map keeps, such as tables, with the map allocator
+ */
+static inline void *hm172_allocate(HM172Map *map, size_t size) {
+    return map->allocator.alloc(map->allocator.context, size);
+}
+
+static inline void *hm172_allocate_zeroed(HM172Map *map, size_t size) {
+    return map->allocator.zero_alloc(map->allocator.context, size);
+}
+
+/*
+ * Does nothing if the pointer is NULL
+ */
+static inline void hm172_deallocate(HM172Map *map, void *pointer, size_t size) {
+    if (pointer != NULL) map->allocator.free(map->allocator.context, pointer, size);
+}
+
+static inline const HM172Allocator *hm172_get_options_allocator(const HM172MapOptions *options) {
+    return options->allocator != NULL ? options->allocator : &hm172_malloc_allocator;
+}
+
+#endif // HASHMAP_172_MAP_ENGINE_H
@@ -0,0 +1,430 @@
+#include <malloc.h>
+#include <memory.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "map_engine.h"
+#include "snapshot.h"
+
+/*
+ * Read-only engine serving a snapshot file mapped to memory
+ * The entries are sorted by bucket, and the bucket index holds the index of the first entry of each bucket,
+ * so the entries of bucket i are the ones from bucket_starts[i] to bucket_starts[i + 1]
+ * Any modification promotes the map to the engine selected by its options
+ */
+
+_Static_assert(sizeof(uintptr_t) == sizeof(HM172Key), "key offsets are stored in the key pointers");
+
+#define SNAPSHOT_MAGIC_LENGTH 8
+
+static const char SNAPSHOT_MAGIC[SNAPSHOT_MAGIC_LENGTH] = {'H', 'M', '1', '7', '2', 'S', 'N', 'P'};
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+static const char PROBE_KEY[] = "HM172 snapshot probe key";
+
+/*
+ * Offsets are counted from the beginning of the file, the entry key pointers hold the offsets of the keys
+ * that aren't inline
+ */
+typedef struct {
+    char magic[SNAPSHOT_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t entry_size;
+    uint32_t hash_size;
+    uint64_t probe_hash; // hash of PROBE_KEY, tells whether the snapshot is opened with the hash function it was saved with
+    uint64_t size;
+    uint64_t capacity; // bucket count, a power of 2
+    uint64_t bucket_offset; // capacity + 1 entry indices
+    uint64_t entry_offset;
+    uint64_t key_offset; // '\0'-terminated keys that aren't inline
+    uint64_t file_size;
+} SnapshotHeader;
+
+typedef struct {
+    char *data;
+    size_t file_size;
+    const uint64_t *bucket_starts;
+    HM172Entry *entries;
+    /*
+     * States of the buckets, a byte per bucket, so that iterators of different bucket ranges can relocate
+     * their buckets from different threads
+     */
+    unsigned char *bucket_states;
+    const engine_t *target_engine;
+} MappedTable;
+
+static MappedTable *get_table(HM172Map *map) {
+    return (MappedTable *) map->table;
+}
+
+enum {
+    BUCKET_UNCHECKED,
+    BUCKET_RELOCATED,
+    BUCKET_CORRUPT // served as empty
+};
+
+/*
+ * Returns whether the key of the entry read from the file lies in the key pool and is '\0'-terminated
+ */
+static bool is_valid_key(MappedTable *table, const HM172Entry *entry) {
+    const SnapshotHeader *header = (const SnapshotHeader *) table->data;
+    if (hm172_is_key_inline(entry->key_length)) return entry->inline_key[entry->key_length] == '\0';
+    uintptr_t offset;
+    memcpy(&offset, &entry->key, sizeof(offset));
+    return offset >= header->key_offset && offset < table->file_size
+           && entry->key_length < table->file_size - offset && table->data[offset + entry->key_length] == '\0';
+}
+
+/*
+ * Replaces the key offsets of the bucket entries with pointers on the first access to the bucket,
+ * so that opening a snapshot doesn't touch the entries, the private mapping copies only the touched pages
+ * The bucket bounds and the keys are checked on the same access, a corrupt bucket is served as empty
+ * and sets the map status to CORRUPT_FILE
+ * Returns whether the bucket isn't corrupt
+ */
+static bool relocate_bucket(HM172Map *map, size_t bucket) {
+    MappedTable *table = get_table(map);
+    if (table->bucket_states[bucket] != BUCKET_UNCHECKED) return table->bucket_states[bucket] == BUCKET_RELOCATED;
+    uint64_t start = table->bucket_starts[bucket], end = table->bucket_starts[bucket + 1];
+    bool valid = start <= end && end <= map->size;
+    for (uint64_t i = start; valid && i < end; i++) valid = is_valid_key(table, table->entries + i);
+    if (!valid) {
+        table->bucket_states[bucket] = BUCKET_CORRUPT;
+        map->status = (HM172Status) {STATUS_CORRUPT_FILE, "snapshot file"};
+        return false;
+    }
+    table->bucket_states[bucket] = BUCKET_RELOCATED;
+    for (uint64_t i = start; i < end; i++) {
+        if (hm172_is_key_inline(table->entries[i].key_length)) continue;
+        uintptr_t offset;
+        memcpy(&offset, &table->entries[i].key, sizeof(offset));
+        table->entries[i].key = table->data + offset;
+    }
+    return true;
+}
+
+static bool init(HM172Map *map, size_t capacity) {
+    (void) map;
+    (void) capacity;
+    return false; // mapped tables are only created by hm172_open_mapped
+}
+
+static void destroy(HM172Map *map) {
+    MappedTable *table = get_table(map);
+    munmap(table->data, table->file_size);
+    hm172_deallocate(map, table->bucket_states, map->capacity);
+    hm172_deallocate(map, table, sizeof(MappedTable));
+}
+
+/*
+ * The promoted table already has the capacity fitting the entries, and the new capacity may be invalid for its engine
+ */
+static void start_resize(HM172Map *map, size_t new_capacity) {
+    (void) new_capacity;
+    hm172_promote(map, get_table(map)->target_engine, true);
+}
+
+static void migrate(HM172Map *map, size_t bucket_count) {
+    (void) map;
+    (void) bucket_count;
+}
+
+/*
+ * Returns the entry with the key or NULL, setting *probe_count to the number of compared entries
+ */
+static HM172Entry *find_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                              size_t *probe_count) {
+    MappedTable *table = get_table(map);
+    size_t bucket = (map->capacity - 1) & hash;
+    *probe_count = 0;
+    if (!relocate_bucket(map, bucket)) return NULL;
+    for (uint64_t i = table->bucket_starts[bucket]; i < table->bucket_starts[bucket + 1]; i++) {
+        HM172Entry *entry = table->entries + i;
+        ++*probe_count;
+        if (entry->hash == hash && hm172_entry_has_key(entry, key, key_length)) return entry;
+    }
+    return NULL;
+}
+
+static HM172Entry *find(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash) {
+    size_t probe_count;
+    HM172Entry *found = find_entry(map, key, key_length, hash, &probe_count);
+    hm172_record_lookup(map, probe_count, found != NULL);
+    return found;
+}
+
+/*
+ * Stages: the bucket index, the first entry of the bucket
+ */
+static void prefetch(HM172Map *map, HM172Hash hash, unsigned stage) {
+    MappedTable *table = get_table(map);
+    const uint64_t *bucket_start = table->bucket_starts + ((map->capacity - 1) & hash);
+    if (stage == 0) PREFETCH(bucket_start);
+    else if (stage == 1) PREFETCH(table->entries + *bucket_start);
+}
+
+/*
+ * Only inserting a new key promotes the map, so that the pointers to the mapped entries stay valid until
+ * a modification
+ */
+static HM172Entry *find_or_insert(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                  bool *inserted) {
+    size_t probe_count;
+    HM172Entry *found = find_entry(map, key, key_length, hash, &probe_count);
+    if (found != NULL) {
+        hm172_record_lookup(map, probe_count, true);
+        *inserted = false;
+        return found;
+    }
+    if (!hm172_promote(map, get_table(map)->target_engine, true)) return NULL;
+    return map->engine->find_or_insert(map, key, key_length, hash, inserted);
+}
+
+static void undo_insert(HM172Map *map, HM172Entry *entry) {
+    (void) map;
+    (void) entry;
+}
+
+/*
+ * Only removing a present key promotes the map
+ */
+static bool remove_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, HM172Entry *removed) {
+    size_t probe_count;
+    if (find_entry(map, key, key_length, hash, &probe_count) == NULL) return false;
+    if (!hm172_promote(map, get_table(map)->target_engine, true)) return false;
+    return map->engine->remove_entry(map, key, key_length, hash, removed);
+}
+
+/*
+ * The keys belong to the file, so there's nothing to free
+ */
+static void clear(HM172Map *map, void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    (void) free_key;
+    hm172_promote(map, get_table(map)->target_engine, false);
+}
+
+/*
+ * Iteration positions are buckets, the entries of which are contiguous
+ */
+static size_t get_iteration_length(HM172Map *map) {
+    return map->capacity;
+}
+
+/*
+ * Positions the iterator at the first entry of the next non-empty bucket, next_index is the bucket after it
+ */
+static void advance_next_index(HM172EntryIterator *iterator) {
+    MappedTable *table = get_table(iterator->map);
+    iterator->next_node = NULL;
+    while (iterator->next_node == NULL && iterator->next_index < iterator->end_index) {
+        size_t bucket = iterator->next_index++;
+        if (table->bucket_starts[bucket] == table->bucket_starts[bucket + 1]
+            || !relocate_bucket(iterator->map, bucket))
+            continue;
+        iterator->next_node = table->entries + table->bucket_starts[bucket];
+    }
+}
+
+static void start_iteration(HM172EntryIterator *iterator) {
+    advance_next_index(iterator);
+}
+
+static HM172Entry *next_entry(HM172EntryIterator *iterator) {
+    HM172Entry *current = iterator->next_node;
+    if (current == NULL) return NULL;
+    MappedTable *table = get_table(iterator->map);
+    if (current + 1 == table->entries + table->bucket_starts[iterator->next_index]) advance_next_index(iterator);
+    else iterator->next_node = current + 1;
+    return current;
+}
+
+static int fprint_stats(HM172Map *map, FILE *stream) {
+    return fprintf(stream, "mapped snapshot size: %zu\n", get_table(map)->file_size);
+}
+
+const engine_t hm172_mapped_engine = {
+        init, destroy, start_resize, migrate, find, prefetch, find_or_insert, undo_insert, remove_entry, NULL, clear,
+        get_iteration_length, start_iteration, next_entry, fprint_stats,
+        1, sizeof(uint64_t), sizeof(HM172Entry), -1
+};
+
+const engine_t *hm172_get_mapped_target_engine(HM172Map *map) {
+    return get_table(map)->target_engine;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + sizeof(uint64_t) - 1) & ~(uint64_t) (sizeof(uint64_t) - 1);
+}
+
+/*
+ * Writes the entries in the bucket order with the key pointers replaced by the offsets of the keys,
+ * which follow the entries in the same order, inline keys are written as a part of their entries
+ */
+static bool write_snapshot(FILE *file, const SnapshotHeader *header, const uint64_t *bucket_starts,
+                           const HM172Entry *entries) {
+    static const char PADDING[sizeof(uint64_t)] = {0};
+    if (fwrite(header, sizeof(SnapshotHeader), 1, file) != 1
+        || fwrite(PADDING, 1, header->bucket_offset - sizeof(SnapshotHeader), file) != header->bucket_offset - sizeof(SnapshotHeader)
+        || fwrite(bucket_starts, sizeof(uint64_t), header->capacity + 1, file) != header->capacity + 1)
+        return false;
+    uintptr_t key_offset = header->key_offset;
+    for (size_t i = 0; i < header->size; i++) {
+        HM172Entry entry;
+        memcpy(&entry, entries + i, sizeof(HM172Entry)); // keeps the zeroed padding
+        if (!hm172_is_key_inline(entry.key_length)) {
+            memcpy(&entry.key, &key_offset, sizeof(key_offset));
+            key_offset += entry.key_length + 1;
+        }
+        if (fwrite(&entry, sizeof(HM172Entry), 1, file) != 1) return false;
+    }
+    for (size_t i = 0; i < header->size; i++)
+        if (!hm172_is_key_inline(entries[i].key_length)
+            && fwrite(entries[i].key, 1, entries[i].key_length + 1, file) != entries[i].key_length + 1)
+            return false;
+    return true;
+}
+
+void hm172_save(HM172Map *map, const char *path) {
+    size_t capacity = 1;
+    while (capacity < map->size) capacity <<= 1u;
+    uint64_t *bucket_starts = calloc(capacity + 1, sizeof(uint64_t));
+    HM172Entry *entries = calloc(map->size == 0 ? 1 : map->size, sizeof(HM172Entry));
+    size_t path_length = strlen(path);
+    char *temporary_path = malloc(path_length + sizeof(".tmp"));
+    if (bucket_starts == NULL || entries == NULL || temporary_path == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "snapshot"};
+        free(bucket_starts);
+        free(entries);
+        free(temporary_path);
+        return;
+    }
+    // counting sort by bucket: bucket_starts[i + 1] counts, then bucket_starts[i] is the next free index of bucket i,
+    // which ends up as the start of bucket i + 1
+    HM172EntryIterator iterator;
+    hm172_init_entry_iterator(&iterator, map);
+    uint64_t key_bytes = 0;
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL;) {
+        bucket_starts[((capacity - 1) & entry->hash) + 1]++;
+        if (!hm172_is_key_inline(entry->key_length)) key_bytes += entry->key_length + 1;
+    }
+    for (size_t i = 1; i <= capacity; i++) bucket_starts[i] += bucket_starts[i - 1];
+    hm172_init_entry_iterator(&iterator, map);
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL;) {
+        HM172Entry *copy = entries + bucket_starts[(capacity - 1) & entry->hash]++;
+        if (hm172_is_key_inline(entry->key_length)) memcpy(copy->inline_key, entry->inline_key, entry->key_length + 1);
+        else copy->key = entry->key;
+        copy->key_length = entry->key_length;
+        copy->hash = entry->hash;
+        copy->value = entry->value;
+    }
+    memmove(bucket_starts + 1, bucket_starts, capacity * sizeof(uint64_t));
+    bucket_starts[0] = 0;
+    SnapshotHeader header = {
+            .version = SNAPSHOT_VERSION,
+            .byte_order_mark = BYTE_ORDER_MARK,
+            .entry_size = sizeof(HM172Entry),
+            .hash_size = sizeof(HM172Hash),
+            .probe_hash = hm172_hash_key(map, PROBE_KEY, sizeof(PROBE_KEY) - 1),
+            .size = map->size,
+            .capacity = capacity,
+            .bucket_offset = align_offset(sizeof(SnapshotHeader))
+    };
+    memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH);
+    header.entry_offset = header.bucket_offset + (capacity + 1) * sizeof(uint64_t);
+    header.key_offset = header.entry_offset + map->size * sizeof(HM172Entry);
+    header.file_size = header.key_offset + key_bytes;
+    memcpy(temporary_path, path, path_length);
+    memcpy(temporary_path + path_length, ".tmp", sizeof(".tmp"));
+    FILE *file = fopen(temporary_path, "wb");
+    bool written = file != NULL && write_snapshot(file, &header, bucket_starts, entries);
+    if (file != NULL && fclose(file) != 0) written = false;
+    if (written && rename(temporary_path, path) != 0) written = false;
+    if (!written) {
+        if (file != NULL) remove(temporary_path);
+        map->status = (HM172Status) {STATUS_WRITE_ERROR, "snapshot file"};
+    }
+    free(bucket_starts);
+    free(entries);
+    free(temporary_path);
+}
+
+static bool is_valid_header(const SnapshotHeader *header, size_t file_size) {
+    return memcmp(header->magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH) == 0
+           && header->version == SNAPSHOT_VERSION
+           && header->byte_order_mark == BYTE_ORDER_MARK
+           && header->entry_size == sizeof(HM172Entry)
+           && header->hash_size == sizeof(HM172Hash)
+           && header->file_size == file_size
+           && header->capacity != 0 && (header->capacity & (header->capacity - 1)) == 0
+           && header->capacity <= MAX_CAPACITY
+           && header->bucket_offset >= sizeof(SnapshotHeader) && header->bucket_offset <= file_size
+           && header->bucket_offset % sizeof(uint64_t) == 0
+           && header->entry_offset == header->bucket_offset + (header->capacity + 1) * sizeof(uint64_t)
+           && header->entry_offset <= file_size
+           && header->size <= (file_size - header->entry_offset) / sizeof(HM172Entry) // no overflow below
+           && header->key_offset == header->entry_offset + header->size * sizeof(HM172Entry);
+}
+
+/*
+ * Maps the file privately: relocation and value updates write to private copies of the pages
+ */
+static MappedTable *map_snapshot(HM172Map *map, const char *path, const engine_t *target_engine) {
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(SnapshotHeader)) {
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    size_t file_size = (size_t) file_stat.st_size;
+    void *data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    const SnapshotHeader *header = data;
+    MappedTable *table = hm172_allocate(map, sizeof(MappedTable));
+    if (!is_valid_header(header, file_size) || table == NULL
+        || ((const uint64_t *) ((char *) data + header->bucket_offset))[header->capacity] != header->size
+        || (table->bucket_states = hm172_allocate_zeroed(map, header->capacity)) == NULL) {
+        munmap(data, file_size);
+        hm172_deallocate(map, table, sizeof(MappedTable));
+        return NULL;
+    }
+    table->data = data;
+    table->file_size = file_size;
+    table->bucket_starts = (const uint64_t *) (table->data + header->bucket_offset);
+    table->entries = (HM172Entry *) (table->data + header->entry_offset);
+    table->target_engine = target_engine;
+    return table;
+}
+
+HM172Map *hm172_open_mapped(const char *path, const HM172MapOptions *options) {
+    const HM172Allocator *allocator = hm172_get_options_allocator(options);
+    HM172Map *map = allocator->alloc(allocator->context, sizeof(HM172Map));
+    if (map == NULL) return NULL;
+    map->allocator = *allocator; // the table is allocated before the other fields are set
+    const engine_t *target_engine = hm172_get_engine(options->engine);
+    MappedTable *table = map_snapshot(map, path, target_engine);
+    if (table == NULL) {
+        hm172_deallocate(map, map, sizeof(HM172Map));
+        return NULL;
+    }
+    const SnapshotHeader *header = (const SnapshotHeader *) table->data;
+    hm172_init_map_fields(map, options, target_engine);
+    map->engine = &hm172_mapped_engine;
+    map->table = table;
+    map->capacity = header->capacity;
+    if (hm172_hash_key(map, PROBE_KEY, sizeof(PROBE_KEY) - 1) != header->probe_hash) {
+        destroy(map);
+        hm172_deallocate(map, map, sizeof(HM172Map));
+        return NULL;
+    }
+    map->size = header->size;
+    map->threshold = -1; // the mapped table never grows, it's promoted on the first put
+    map->shrink_threshold = -1;
+#ifdef HM172_STATS
+    map->counters.key_bytes = header->file_size - header->key_offset;
+#endif
+    return map;
+}
@@ -0,0 +1,119 @@
+#ifndef HASHMAP_172_MUM_HASH_H
+#define HASHMAP_172_MUM_HASH_H
+
+/*
+ * Header-only version of hm172_mum_hash, so that it can be inlined into the callers that fix the hash function
+ * at compile time, see specialized_map.h
+ * The functions return exactly the same hashes as hm172_mum_hash and hm172_mum_hash_64, which are defined with them
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "hash.h"
+
+#define HM172_MUM_PRIME_0 UINT64_C(0xA0761D6478BD642F)
+#define HM172_MUM_PRIME_1 UINT64_C(0xE7037ED1A0B428DB)
+#define HM172_MUM_PRIME_2 UINT64_C(0x8EBC6AF09C88C6E3)
+#define HM172_MUM_PRIME_3 UINT64_C(0x589965CC75374CC3)
+
+static inline HM172Hash hm172_fold_hash(uint64_t hash) {
+    return (HM172Hash) (sizeof(HM172Hash) < sizeof(uint64_t) ? hash ^ (hash >> 32u) : hash);
+}
+
+/*
+ * Sets *a and *b to the low and the high halves of the 128 bit product of *a and *b
+ */
+static inline void hm172_multiply_128(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t) *a * *b;
+    *a = (uint64_t) product;
+    *b = (uint64_t) (product >> 64u);
+#else
+    uint64_t a_high = *a >> 32u, a_low = (uint32_t) *a, b_high = *b >> 32u, b_low = (uint32_t) *b;
+    uint64_t high = a_high * b_high, middle_1 = a_high * b_low, middle_2 = a_low * b_high, low = a_low * b_low;
+    uint64_t middle = middle_1 + middle_2;
+    uint64_t carry = (middle < middle_1 ? UINT64_C(1) << 32u : 0) + (low + (middle << 32u) < low);
+    *a = low + (middle << 32u);
+    *b = high + (middle >> 32u) + carry;
+#endif
+}
+
+/*
+ * Folds the 128 bit product of a and b, each bit of the result depends on all the bits of both arguments
+ */
+static inline uint64_t hm172_mum_mix(uint64_t a, uint64_t b) {
+    hm172_multiply_128(&a, &b);
+    return a ^ b;
+}
+
+/*
+ * Unaligned little endian reads (native order reads are used, so the hashes differ on big endian platforms)
+ */
+static inline uint64_t hm172_read_64(const unsigned char *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+static inline uint64_t hm172_read_32(const unsigned char *bytes) {
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/*
+ * Reads 1 to 3 bytes as a single word, covering each byte at least once
+ */
+static inline uint64_t hm172_read_small(const unsigned char *bytes, size_t length) {
+    return ((uint64_t) bytes[0] << 16u) | ((uint64_t) bytes[length >> 1u] << 8u) | bytes[length - 1];
+}
+
+static inline uint64_t hm172_mum_hash_64_inline(const char *str, size_t length, uint64_t seed) {
+    const unsigned char *bytes = (const unsigned char *) str;
+    seed ^= hm172_mum_mix(seed ^ HM172_MUM_PRIME_0, HM172_MUM_PRIME_1);
+    uint64_t a, b;
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t offset = (length >> 3u) << 2u; // the two 4 byte reads from each side overlap for lengths below 8
+            a = (hm172_read_32(bytes) << 32u) | hm172_read_32(bytes + offset);
+            b = (hm172_read_32(bytes + length - 4) << 32u) | hm172_read_32(bytes + length - 4 - offset);
+        } else if (length > 0) {
+            a = hm172_read_small(bytes, length);
+            b = 0;
+        } else a = b = 0;
+    } else {
+        size_t left = length;
+        if (left > 48) {
+            // three independent multiplication chains hide the multiplication latency
+            uint64_t seed_1 = seed, seed_2 = seed;
+            do {
+                seed = hm172_mum_mix(hm172_read_64(bytes) ^ HM172_MUM_PRIME_1, hm172_read_64(bytes + 8) ^ seed);
+                seed_1 = hm172_mum_mix(hm172_read_64(bytes + 16) ^ HM172_MUM_PRIME_2,
+                                       hm172_read_64(bytes + 24) ^ seed_1);
+                seed_2 = hm172_mum_mix(hm172_read_64(bytes + 32) ^ HM172_MUM_PRIME_3,
+                                       hm172_read_64(bytes + 40) ^ seed_2);
+                bytes += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= seed_1 ^ seed_2;
+        }
+        while (left > 16) {
+            seed = hm172_mum_mix(hm172_read_64(bytes) ^ HM172_MUM_PRIME_1, hm172_read_64(bytes + 8) ^ seed);
+            bytes += 16;
+            left -= 16;
+        }
+        a = hm172_read_64(bytes + left - 16);
+        b = hm172_read_64(bytes + left - 8);
+    }
+    a ^= HM172_MUM_PRIME_1;
+    b ^= seed;
+    hm172_multiply_128(&a, &b);
+    return hm172_mum_mix(a ^ HM172_MUM_PRIME_0 ^ length, b ^ HM172_MUM_PRIME_1);
+}
+
+static inline HM172Hash hm172_mum_hash_inline(const char *str, size_t length, uint64_t seed) {
+    return hm172_fold_hash(hm172_mum_hash_64_inline(str, length, seed));
+}
+
+#endif // HASHMAP_172_MUM_HASH_H
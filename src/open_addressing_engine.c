@@ -0,0 +1,306 @@
+#include <memory.h>
+#include "map_engine.h"
+#include "control_group.h"
+
+/*
+ * Open addressing with a control byte array: entries are stored inline in the slot array,
+ * and control bytes holding 7 bit fingerprints of the hashes are probed a group at a time
+ * The slot array is followed by the control bytes in the same allocation
+ */
+
+static const size_t MIN_CAPACITY = GROUP_WIDTH;
+
+static HM172Entry *get_slots(void *table) {
+    return (HM172Entry *) table;
+}
+
+static HM172Control *get_controls(void *table, size_t capacity) {
+    return (HM172Control *) (get_slots(table) + capacity);
+}
+
+static size_t get_table_size(size_t capacity) {
+    return capacity * (sizeof(HM172Entry) + sizeof(HM172Control));
+}
+
+static void *new_table(HM172Map *map, size_t capacity) {
+    HM172Entry *slots = hm172_allocate(map, get_table_size(capacity));
+    if (slots == NULL) return NULL;
+    memset(slots + capacity, CONTROL_EMPTY, capacity * sizeof(HM172Control));
+    return slots;
+}
+
+static bool init(HM172Map *map, size_t capacity) {
+    map->table = new_table(map, capacity);
+    if (map->table == NULL) return false;
+    map->capacity = capacity;
+    return true;
+}
+
+static void destroy(HM172Map *map) {
+    hm172_deallocate(map, map->table, get_table_size(map->capacity));
+    hm172_deallocate(map, map->old_table, get_table_size(map->old_capacity));
+}
+
+static void start_resize(HM172Map *map, size_t new_capacity) {
+    void *table = new_table(map, new_capacity);
+    if (table == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "resized table"};
+        return;
+    }
+    map->old_table = map->table;
+    map->old_capacity = map->capacity;
+    map->migrated_bucket_count = 0;
+    map->table = table;
+    map->capacity = new_capacity;
+    map->deleted_count = 0;
+}
+
+/*
+ * A bucket of the old table is a group of slots, moved slots are marked deleted, so that old table probes go past them
+ */
+static void migrate(HM172Map *map, size_t bucket_count) {
+    size_t old_group_count = map->old_capacity / GROUP_WIDTH;
+    size_t end = old_group_count - map->migrated_bucket_count > bucket_count
+                 ? map->migrated_bucket_count + bucket_count : old_group_count;
+    HM172Entry *old_slots = get_slots(map->old_table);
+    HM172Control *old_controls = get_controls(map->old_table, map->old_capacity);
+    HM172Entry *slots = get_slots(map->table);
+    HM172Control *controls = get_controls(map->table, map->capacity);
+    for (size_t i = map->migrated_bucket_count * GROUP_WIDTH; i < end * GROUP_WIDTH; i++) {
+        if (old_controls[i] & CONTROL_EMPTY) continue;
+        uint64_t mixed_hash = hm172_mix_hash(old_slots[i].hash);
+        size_t index = hm172_find_free_slot(controls, map->capacity, mixed_hash);
+        if (controls[index] == CONTROL_DELETED) map->deleted_count--;
+        controls[index] = hm172_fingerprint(mixed_hash);
+        slots[index] = old_slots[i];
+        old_controls[i] = CONTROL_DELETED;
+    }
+    map->migrated_bucket_count = end;
+    if (end == old_group_count) {
+        hm172_deallocate(map, map->old_table, get_table_size(map->old_capacity));
+        map->old_table = NULL;
+    }
+}
+
+/*
+ * Adds the number of probed groups to *probe_count
+ */
+static HM172Entry *find_in_table(void *table, size_t capacity, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                 size_t *probe_count) {
+    HM172Entry *slots = get_slots(table);
+    HM172Control *controls = get_controls(table, capacity);
+    uint64_t mixed_hash = hm172_mix_hash(hash);
+    HM172Control fingerprint = hm172_fingerprint(mixed_hash);
+    size_t group_count = capacity / GROUP_WIDTH;
+    size_t group = mixed_hash & (group_count - 1);
+    for (size_t step = 1; step <= group_count; step++) {
+        HM172Control *group_controls = controls + group * GROUP_WIDTH;
+        HM172Entry *group_slots = slots + group * GROUP_WIDTH;
+        (*probe_count)++;
+        for (HM172GroupMask mask = hm172_match_byte(group_controls, fingerprint); mask != 0; mask &= mask - 1) {
+            HM172Entry *entry = group_slots + hm172_lowest_set_bit(mask);
+            if (entry->hash == hash && hm172_entry_has_key(entry, key, key_length)) return entry;
+        }
+        if (hm172_match_empty(group_controls) != 0) return NULL;
+        group = (group + step) & (group_count - 1);
+    }
+    return NULL;
+}
+
+static HM172Entry *find(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash) {
+    size_t probe_count = 0;
+    HM172Entry *entry = find_in_table(map->table, map->capacity, key, key_length, hash, &probe_count);
+    if (entry == NULL && map->old_table != NULL)
+        entry = find_in_table(map->old_table, map->old_capacity, key, key_length, hash, &probe_count);
+    hm172_record_lookup(map, probe_count, entry != NULL);
+    return entry;
+}
+
+/*
+ * Stages: the control bytes of the first probed group, the first slot with a matching fingerprint,
+ * its key if it isn't inline
+ */
+static void prefetch(HM172Map *map, HM172Hash hash, unsigned stage) {
+    uint64_t mixed_hash = hm172_mix_hash(hash);
+    size_t group_index = (mixed_hash & (map->capacity / GROUP_WIDTH - 1)) * GROUP_WIDTH;
+    HM172Control *group_controls = get_controls(map->table, map->capacity) + group_index;
+    if (stage == 0) {
+        PREFETCH(group_controls);
+        return;
+    }
+    HM172GroupMask mask = hm172_match_byte(group_controls, hm172_fingerprint(mixed_hash));
+    if (mask == 0) return;
+    HM172Entry *entry = get_slots(map->table) + group_index + hm172_lowest_set_bit(mask);
+    if (stage == 1) PREFETCH(entry);
+    else if (!hm172_is_key_inline(entry->key_length)) PREFETCH(entry->key);
+}
+
+/*
+ * Remembers the first empty or deleted slot while looking for the key, so that a new entry goes there
+ * without probing the table again
+ */
+static HM172Entry *find_or_insert(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash,
+                                  bool *inserted) {
+    HM172Entry *slots = get_slots(map->table);
+    HM172Control *controls = get_controls(map->table, map->capacity);
+    uint64_t mixed_hash = hm172_mix_hash(hash);
+    HM172Control fingerprint = hm172_fingerprint(mixed_hash);
+    size_t group_count = map->capacity / GROUP_WIDTH;
+    size_t group = mixed_hash & (group_count - 1);
+    size_t free_index = SIZE_MAX, probe_count = 0;
+    *inserted = false;
+    for (size_t step = 1; step <= group_count; step++) {
+        HM172Control *group_controls = controls + group * GROUP_WIDTH;
+        HM172Entry *group_slots = slots + group * GROUP_WIDTH;
+        probe_count++;
+        for (HM172GroupMask mask = hm172_match_byte(group_controls, fingerprint); mask != 0; mask &= mask - 1) {
+            HM172Entry *entry = group_slots + hm172_lowest_set_bit(mask);
+            if (entry->hash == hash && hm172_entry_has_key(entry, key, key_length)) {
+                hm172_record_lookup(map, probe_count, true);
+                return entry;
+            }
+        }
+        if (free_index == SIZE_MAX) {
+            HM172GroupMask free_mask = hm172_match_empty_or_deleted(group_controls);
+            if (free_mask != 0) free_index = group * GROUP_WIDTH + hm172_lowest_set_bit(free_mask);
+        }
+        if (hm172_match_empty(group_controls) != 0) break;
+        group = (group + step) & (group_count - 1);
+    }
+    HM172Entry *entry = map->old_table == NULL ? NULL
+                        : find_in_table(map->old_table, map->old_capacity, key, key_length, hash, &probe_count);
+    hm172_record_lookup(map, probe_count, entry != NULL);
+    if (entry != NULL) return entry;
+    if (free_index == SIZE_MAX) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "table slot"};
+        return NULL;
+    }
+    *inserted = true;
+    if (controls[free_index] == CONTROL_DELETED) map->deleted_count--;
+    controls[free_index] = fingerprint;
+    slots[free_index].hash = hash;
+    return slots + free_index;
+}
+
+/*
+ * The slot is marked deleted rather than empty, as it could have been deleted before the insertion
+ */
+static void undo_insert(HM172Map *map, HM172Entry *entry) {
+    get_controls(map->table, map->capacity)[entry - get_slots(map->table)] = CONTROL_DELETED;
+    map->deleted_count++;
+}
+
+/*
+ * Returns whether the slot is marked deleted
+ */
+static bool erase_slot(void *table, size_t capacity, HM172Entry *entry) {
+    return hm172_erase_control(get_controls(table, capacity), entry - get_slots(table));
+}
+
+static bool remove_entry(HM172Map *map, HM172ConstKey key, size_t key_length, HM172Hash hash, HM172Entry *removed) {
+    size_t probe_count = 0;
+    HM172Entry *entry = find_in_table(map->table, map->capacity, key, key_length, hash, &probe_count);
+    if (entry != NULL) {
+        *removed = *entry;
+        if (erase_slot(map->table, map->capacity, entry)) map->deleted_count++;
+    } else if (map->old_table != NULL
+               && (entry = find_in_table(map->old_table, map->old_capacity, key, key_length, hash,
+                                         &probe_count)) != NULL) {
+        *removed = *entry;
+        erase_slot(map->old_table, map->old_capacity, entry);
+    }
+    hm172_record_lookup(map, probe_count, entry != NULL);
+    return entry != NULL;
+}
+
+static void clear_table(HM172Map *map, void *table, size_t capacity,
+                        void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    HM172Entry *slots = get_slots(table);
+    HM172Control *controls = get_controls(table, capacity);
+    if (free_key != NULL)
+        for (size_t i = 0; i < capacity; i++)
+            if (!(controls[i] & CONTROL_EMPTY)) free_key(map, slots + i);
+    memset(controls, CONTROL_EMPTY, capacity * sizeof(HM172Control));
+}
+
+static void clear(HM172Map *map, void (*free_key)(HM172Map *map, HM172Entry *entry)) {
+    clear_table(map, map->table, map->capacity, free_key);
+    map->deleted_count = 0;
+    if (map->old_table != NULL) {
+        clear_table(map, map->old_table, map->old_capacity, free_key);
+        hm172_deallocate(map, map->old_table, get_table_size(map->old_capacity));
+        map->old_table = NULL;
+    }
+}
+
+/*
+ * Iteration positions are slots, indices below the old capacity refer to the old table slots
+ * while a resize is in progress
+ */
+static size_t get_iteration_length(HM172Map *map) {
+    return (map->old_table == NULL ? 0 : map->old_capacity) + map->capacity;
+}
+
+static void start_iteration(HM172EntryIterator *iterator) {
+    (void) iterator;
+}
+
+static HM172Entry *next_entry(HM172EntryIterator *iterator) {
+    HM172Map *map = iterator->map;
+    size_t old_capacity = map->old_table == NULL ? 0 : map->old_capacity;
+    while (iterator->next_index < iterator->end_index) {
+        size_t index = iterator->next_index++;
+        void *table = map->table;
+        size_t capacity = map->capacity;
+        if (index < old_capacity) {
+            table = map->old_table;
+            capacity = old_capacity;
+        } else index -= old_capacity;
+        if (!(get_controls(table, capacity)[index] & CONTROL_EMPTY)) return get_slots(table) + index;
+    }
+    return NULL;
+}
+
+/*
+ * Returns the number of groups probed by a successful lookup of the entry stored in the slot with the given index
+ */
+static size_t get_probe_length(void *table, size_t capacity, size_t index) {
+    size_t group_mask = capacity / GROUP_WIDTH - 1;
+    size_t group = hm172_mix_hash(get_slots(table)[index].hash) & group_mask;
+    size_t probe_length = 1;
+    for (size_t step = 1; group != index / GROUP_WIDTH; step++, probe_length++)
+        group = (group + step) & group_mask;
+    return probe_length;
+}
+
+static void add_probe_lengths(void *table, size_t capacity, size_t *total_probe_length, size_t *max_probe_length) {
+    HM172Control *controls = get_controls(table, capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        if (controls[i] & CONTROL_EMPTY) continue;
+        size_t probe_length = get_probe_length(table, capacity, i);
+        *total_probe_length += probe_length;
+        if (probe_length > *max_probe_length) *max_probe_length = probe_length;
+    }
+}
+
+static int fprint_stats(HM172Map *map, FILE *stream) {
+    size_t total_probe_length = 0, max_probe_length = 0;
+    add_probe_lengths(map->table, map->capacity, &total_probe_length, &max_probe_length);
+    if (map->old_table != NULL)
+        add_probe_lengths(map->old_table, map->old_capacity, &total_probe_length, &max_probe_length);
+    if (map->old_table != NULL && fprintf(stream, "migrated old groups: %zu of %zu\n",
+                                          map->migrated_bucket_count, map->old_capacity / GROUP_WIDTH) < 0)
+        return -1;
+    return fprintf(stream, "group count: %zu\n"
+                           "deleted slot count: %zu\n"
+                           "average probe length: %f\n"
+                           "max probe length: %zu\n",
+                   map->capacity / GROUP_WIDTH, map->deleted_count, total_probe_length / (float) map->size,
+                   max_probe_length);
+}
+
+const engine_t hm172_open_addressing_engine = {
+        init, destroy, start_resize, migrate, find, prefetch, find_or_insert, undo_insert, remove_entry, NULL, clear,
+        get_iteration_length, start_iteration, next_entry, fprint_stats,
+        MIN_CAPACITY, sizeof(HM172Entry) + sizeof(HM172Control), 0, 0.875f
+};
@@ -0,0 +1,184 @@
+#include <malloc.h>
+#include <memory.h>
+#include <limits.h>
+#include <pthread.h>
+#include "ranking.h"
+#include "map_engine.h"
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1u << RADIX_BITS)
+#define RADIX_PASS_COUNT (sizeof(HM172Value) * CHAR_BIT / RADIX_BITS)
+
+int hm172_compare_entry_values(const HM172Entry *entry, const HM172Entry *other_entry) {
+    return (entry->value > other_entry->value) - (entry->value < other_entry->value);
+}
+
+/*
+ * The heap root is the lowest ranking entry, so that it is the one replaced by a higher ranking entry
+ */
+static void sift_down(HM172Entry **heap, size_t count, size_t index, entry_compare_function_t compare) {
+    HM172Entry *entry = heap[index];
+    for (size_t child; (child = 2 * index + 1) < count; index = child) {
+        if (child + 1 < count && compare(heap[child + 1], heap[child]) < 0) child++;
+        if (compare(heap[child], entry) >= 0) break;
+        heap[index] = heap[child];
+    }
+    heap[index] = entry;
+}
+
+static void sift_up(HM172Entry **heap, size_t index, entry_compare_function_t compare) {
+    HM172Entry *entry = heap[index];
+    for (size_t parent; index > 0 && compare(heap[parent = (index - 1) / 2], entry) > 0; index = parent)
+        heap[index] = heap[parent];
+    heap[index] = entry;
+}
+
+/*
+ * Adds the entry to the heap of up to k entries holding count of them, returns the new count
+ */
+static size_t push_top_k(HM172Entry **heap, size_t count, size_t k, HM172Entry *entry,
+                         entry_compare_function_t compare) {
+    if (count < k) {
+        heap[count] = entry;
+        sift_up(heap, count, compare);
+        return count + 1;
+    }
+    if (compare(entry, heap[0]) > 0) {
+        heap[0] = entry;
+        sift_down(heap, count, 0, compare);
+    }
+    return count;
+}
+
+/*
+ * Moves the lowest ranking entry to the end until the heap is sorted highest first
+ */
+static void sort_heap(HM172Entry **heap, size_t count, entry_compare_function_t compare) {
+    for (size_t end = count; end > 1; end--) {
+        HM172Entry *lowest = heap[0];
+        heap[0] = heap[end - 1];
+        heap[end - 1] = lowest;
+        sift_down(heap, end - 1, 0, compare);
+    }
+}
+
+typedef struct {
+    HM172EntryIterator iterator;
+    HM172Entry **heap;
+    size_t k;
+    entry_compare_function_t compare;
+    size_t count;
+} TopKTask;
+
+static void *collect_top_k(void *task_ptr) {
+    TopKTask *task = task_ptr;
+    const engine_t *engine = task->iterator.map->engine;
+    for (HM172Entry *entry; (entry = engine->next_entry(&task->iterator)) != NULL;)
+        task->count = push_top_k(task->heap, task->count, task->k, entry, task->compare);
+    return NULL;
+}
+
+size_t hm172_top_k(HM172Map *map, size_t k, entry_compare_function_t compare, HM172Entry **out) {
+    TopKTask task = {.heap = out, .k = k < map->size ? k : map->size, .compare = compare, .count = 0};
+    if (task.k == 0) return 0;
+    hm172_init_entry_iterator(&task.iterator, map);
+    collect_top_k(&task);
+    sort_heap(out, task.count, compare);
+    return task.count;
+}
+
+/*
+ * The first task runs in the calling thread, as do the tasks whose threads can't be created,
+ * and uses out as its heap
+ */
+size_t hm172_top_k_parallel(HM172Map *map, size_t k, entry_compare_function_t compare, HM172Entry **out,
+                            size_t thread_count) {
+    size_t length = map->engine->get_iteration_length(map);
+    if (thread_count > length) thread_count = length;
+    if (k > map->size) k = map->size;
+    if (thread_count <= 1 || k == 0) return hm172_top_k(map, k, compare, out);
+    TopKTask *tasks = malloc(thread_count * sizeof(TopKTask));
+    HM172Entry **heaps = malloc((thread_count - 1) * k * sizeof(HM172Entry *));
+    pthread_t *threads = malloc(thread_count * sizeof(pthread_t));
+    bool *is_started = calloc(thread_count, sizeof(bool));
+    if (tasks == NULL || heaps == NULL || threads == NULL || is_started == NULL) {
+        free(tasks);
+        free(heaps);
+        free(threads);
+        free(is_started);
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "top k heaps"};
+        return 0;
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        tasks[i] = (TopKTask) {.heap = i == 0 ? out : heaps + (i - 1) * k, .k = k, .compare = compare, .count = 0};
+        hm172_init_entry_range_iterator(&tasks[i].iterator, map, length * i / thread_count,
+                                        length * (i + 1) / thread_count);
+    }
+    for (size_t i = 1; i < thread_count; i++)
+        is_started[i] = pthread_create(&threads[i], NULL, collect_top_k, &tasks[i]) == 0;
+    collect_top_k(&tasks[0]);
+    size_t count = tasks[0].count;
+    for (size_t i = 1; i < thread_count; i++) {
+        if (is_started[i]) pthread_join(threads[i], NULL);
+        else collect_top_k(&tasks[i]);
+        for (size_t j = 0; j < tasks[i].count; j++) count = push_top_k(out, count, k, tasks[i].heap[j], compare);
+    }
+    sort_heap(out, count, compare);
+    free(tasks);
+    free(heaps);
+    free(threads);
+    free(is_started);
+    return count;
+}
+
+/*
+ * Maps the values to unsigned integers in the sorted order, flipping the sign bit
+ */
+static unsigned get_radix_key(const HM172Entry *entry, bool descending) {
+    unsigned key = (unsigned) entry->value ^ ~(UINT_MAX >> 1u);
+    return descending ? ~key : key;
+}
+
+static unsigned get_digit(unsigned key, size_t pass) {
+    return (key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1);
+}
+
+size_t hm172_export_sorted(HM172Map *map, HM172Entry **out, bool descending) {
+    size_t count = map->size;
+    if (count == 0) return 0;
+    HM172Entry **buffer = malloc(count * sizeof(HM172Entry *));
+    if (buffer == NULL) {
+        map->status = (HM172Status) {STATUS_OUT_OF_MEMORY, "sort buffer"};
+        return 0;
+    }
+    // the digit counts of all the passes are taken in the same scan of the entries
+    size_t digit_counts[RADIX_PASS_COUNT][RADIX_SIZE] = {{0}};
+    HM172EntryIterator iterator;
+    hm172_init_entry_iterator(&iterator, map);
+    size_t i = 0;
+    for (HM172Entry *entry; (entry = map->engine->next_entry(&iterator)) != NULL; i++) {
+        out[i] = entry;
+        unsigned key = get_radix_key(entry, descending);
+        for (size_t pass = 0; pass < RADIX_PASS_COUNT; pass++) digit_counts[pass][get_digit(key, pass)]++;
+    }
+    HM172Entry **source = out, **destination = buffer;
+    for (size_t pass = 0; pass < RADIX_PASS_COUNT; pass++) {
+        size_t *counts = digit_counts[pass];
+        // a pass over a digit that is the same for all the values wouldn't move anything
+        if (counts[get_digit(get_radix_key(out[0], descending), pass)] == count) continue;
+        size_t offset = 0;
+        for (unsigned digit = 0; digit < RADIX_SIZE; digit++) {
+            size_t digit_count = counts[digit];
+            counts[digit] = offset;
+            offset += digit_count;
+        }
+        for (i = 0; i < count; i++)
+            destination[counts[get_digit(get_radix_key(source[i], descending), pass)]++] = source[i];
+        HM172Entry **sorted = destination;
+        destination = source;
+        source = sorted;
+    }
+    if (source != out) memcpy(out, source, count * sizeof(HM172Entry *));
+    free(buffer);
+    return count;
+}
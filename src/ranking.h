@@ -0,0 +1,46 @@
+#ifndef HASHMAP_172_RANKING_H
+#define HASHMAP_172_RANKING_H
+
+#include "map.h"
+
+/*
+ * Returns a positive number if the entry ranks higher than the other entry, a negative one if it ranks lower,
+ * and 0 if they rank the same
+ */
+typedef int (*entry_compare_function_t)(const HM172Entry *entry, const HM172Entry *other_entry);
+
+/*
+ * Ranks entries by their values
+ */
+int hm172_compare_entry_values(const HM172Entry *entry, const HM172Entry *other_entry);
+
+/*
+ * Stores the pointers to the k highest ranking entries to out, highest first, and returns their number,
+ * which is less than k if the map has fewer entries
+ * Keeps a heap of k entry pointers in out instead of copying all of the entries, so it takes O(size * log(k)) time
+ * Of the entries ranking the same, the ones iterated over first are preferred
+ * The comparison function must not modify the map
+ */
+size_t hm172_top_k(HM172Map *map, size_t k, entry_compare_function_t compare, HM172Entry **out);
+
+/*
+ * hm172_top_k that splits the table positions into thread_count ranges scanned by separate threads,
+ * each of which keeps its own heap of k entry pointers, the heaps are then merged
+ * The comparison function is called from different threads
+ * Of the entries ranking the same, any can be preferred
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY and 0 is returned
+ */
+size_t hm172_top_k_parallel(HM172Map *map, size_t k, entry_compare_function_t compare, HM172Entry **out,
+                            size_t thread_count);
+
+/*
+ * Stores the pointers to all the entries to out, which must have space for hm172_size(map) of them,
+ * sorted by value in ascending or descending order, and returns their number
+ * Entries with equal values are stored in the iteration order
+ * Uses a radix sort by a byte of the value at a time, skipping the bytes that are the same for all the values,
+ * with a temporary array of hm172_size(map) entry pointers
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY and 0 is returned
+ */
+size_t hm172_export_sorted(HM172Map *map, HM172Entry **out, bool descending);
+
+#endif // HASHMAP_172_RANKING_H
@@ -0,0 +1,30 @@
+#ifndef HASHMAP_172_SNAPSHOT_H
+#define HASHMAP_172_SNAPSHOT_H
+
+#include "map.h"
+
+/*
+ * Writes the map entries to the file at the path as a snapshot that hm172_open_mapped maps to memory
+ * The snapshot holds a bucket index, the entries with their hashes and a key pool, referring to each other by offsets
+ * The file is written next to the path and renamed, so a snapshot is never seen partially written
+ * Snapshots can only be opened by builds with the same entry layout (HM172_HASH_64, pointer size) and byte order
+ * If sufficient amount of memory can't be allocated, the map state type is set to OUT_OF_MEMORY,
+ * and if the file can't be written, it is set to WRITE_ERROR
+ */
+void hm172_save(HM172Map *map, const char *path);
+
+/*
+ * Returns a map serving hm172_get and iteration directly from the memory mapped snapshot at the path,
+ * so opening takes constant time and the file pages are only read when they are accessed
+ * The options must have the hash function and the seed the snapshot was saved with, the other options are applied
+ * when the map is promoted: the first put of a new key, removal of a present key or clear copies the entries
+ * to a normal map and unmaps the file, invalidating the entry, key and value pointers obtained before it
+ * Values can be changed through the pointers returned by hm172_get without promotion, the file is never changed
+ * The buckets are checked on their first access: the entries of a corrupt bucket are skipped,
+ * and the map status type is set to CORRUPT_FILE
+ * Returns NULL if the file can't be mapped, isn't a snapshot compatible with this build, was saved with a different
+ * hash function, or sufficient amount of memory can't be allocated
+ */
+HM172Map *hm172_open_mapped(const char *path, const HM172MapOptions *options);
+
+#endif // HASHMAP_172_SNAPSHOT_H
@@ -0,0 +1,57 @@
+#ifndef HASHMAP_172_SPECIALIZED_MAP_H
+#define HASHMAP_172_SPECIALIZED_MAP_H
+
+/*
+ * Code generator of HM172Map accessors specialized for a hash function fixed at compile time
+ * hm172_get_n and the others call the hash function of the map through a pointer, so it can't be inlined,
+ * while the specialized accessors are static inline and hash the keys with a static inline function themselves,
+ * passing the hashes to the *_hashed functions; the map is still probed by its engine, chosen at runtime,
+ * so only the hash call is removed, and the probe and the key comparison are still out of line
+ * For a table with the probes inlined as well, with keys and values of any types, see generic_map.h
+ *
+ * HM172_DEFINE_SPECIALIZED_MAP(name, inline_hash_function);
+ * defines the functions below, where
+ *  - inline_hash_function: HM172Hash (const char *key, size_t length, uint64_t seed), preferably static inline,
+ *    e.g. hm172_mum_hash_inline from mum_hash.h
+ *
+ * HM172Map *name_new(const HM172MapOptions *options), same as hm172_new_map_with_options with the hash_n_function
+ *     of the options replaced with inline_hash_function, so that the map hashes keys the same way as the accessors
+ * HM172Value *name_get(HM172Map *map, HM172ConstKey key, size_t length)
+ * void name_put(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value)
+ * HM172Value *name_get_or_put(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value, bool *inserted)
+ * bool name_remove(HM172Map *map, HM172ConstKey key, size_t length, HM172Value *value), value can be NULL
+ * The functions behave as their *_n counterparts
+ * Using the accessors with a map created by other means than name_new is UNDEFINED BEHAVIOUR
+ */
+
+#include "map.h"
+
+#define HM172_DEFINE_SPECIALIZED_MAP(name, inline_hash_function)                                                       \
+static inline HM172Map *name##_new(const HM172MapOptions *options) {                                                   \
+    HM172MapOptions specialized_options = *options;                                                                    \
+    specialized_options.hash_n_function = inline_hash_function;                                                        \
+    return hm172_new_map_with_options(&specialized_options);                                                           \
+}                                                                                                                      \
+                                                                                                                       \
+static inline HM172Hash name##_hash(HM172Map *map, HM172ConstKey key, size_t length) {                                 \
+    return inline_hash_function(key, length, hm172_get_hash_seed(map));                                                \
+}                                                                                                                      \
+                                                                                                                       \
+static inline HM172Value *name##_get(HM172Map *map, HM172ConstKey key, size_t length) {                                \
+    return hm172_get_hashed(map, key, length, name##_hash(map, key, length));                                          \
+}                                                                                                                      \
+                                                                                                                       \
+static inline void name##_put(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value) {                     \
+    hm172_put_hashed(map, key, length, name##_hash(map, key, length), value);                                          \
+}                                                                                                                      \
+                                                                                                                       \
+static inline HM172Value *name##_get_or_put(HM172Map *map, HM172ConstKey key, size_t length, HM172Value value,         \
+                                            bool *inserted) {                                                          \
+    return hm172_get_or_put_hashed(map, key, length, name##_hash(map, key, length), value, inserted);                  \
+}                                                                                                                      \
+                                                                                                                       \
+static inline bool name##_remove(HM172Map *map, HM172ConstKey key, size_t length, HM172Value *value) {                 \
+    return hm172_remove_hashed(map, key, length, name##_hash(map, key, length), value);                                \
+}
+
+#endif // HASHMAP_172_SPECIALIZED_MAP_H
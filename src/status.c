@@ -7,6 +7,8 @@ char *hm172_status_type_to_message_format(HM172StatusType status_type) {
         case STATUS_OUT_OF_MEMORY: return "Unable to allocate memory for %s\n";
         case STATUS_CONCURRENT_MODIFICATION: return "Concurrent modification occurred while using %s\n";
         case PRINT_ERROR: return "Unable to print %s\n";
+        case STATUS_WRITE_ERROR: return "Unable to write %s\n";
+        case STATUS_CORRUPT_FILE: return "Corrupt data in %s\n";
         default: return "Unknown error\n";
     }
 }
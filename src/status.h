@@ -10,7 +10,9 @@ typedef enum {
     STATUS_OK, // no data required
     STATUS_OUT_OF_MEMORY, // data must hold variable name
     STATUS_CONCURRENT_MODIFICATION, // data must hold the name of the entity that was unable to handle concurrent modification
-    PRINT_ERROR // data must hold message name
+    PRINT_ERROR, // data must hold message name
+    STATUS_WRITE_ERROR, // data must hold the file name
+    STATUS_CORRUPT_FILE // data must hold the file name
 } HM172StatusType;
 
 typedef struct {
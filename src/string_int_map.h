@@ -0,0 +1,40 @@
+#ifndef HASHMAP_172_STRING_INT_MAP_H
+#define HASHMAP_172_STRING_INT_MAP_H
+
+#include <string.h>
+#include "generic_map.h"
+#include "mum_hash.h"
+#include "map.h"
+
+/*
+ * The string to int map of map.h specialized by generic_map.h: hm172_string_int_map_t owns '\0'-terminated copies
+ * of its HM172Key keys and stores HM172Value values inline
+ * It has none of the options of HM172Map, in exchange each operation is a single inlined probe of one table,
+ * keys are hashed with hm172_mum_hash_64_inline from mum_hash.h
+ */
+
+static inline uint64_t hm172_string_int_map_hash(HM172Key key) {
+    return hm172_mum_hash_64_inline(key, strlen(key), 0);
+}
+
+static inline bool hm172_string_int_map_equals(HM172Key key, HM172Key other_key) {
+    return strcmp(key, other_key) == 0;
+}
+
+static inline bool hm172_string_int_map_copy_key(HM172Key key, HM172Key *copy) {
+    size_t size = (strlen(key) + 1) * sizeof(char); // including '\0'
+    *copy = malloc(size);
+    if (*copy == NULL) return false;
+    memcpy(*copy, key, size);
+    return true;
+}
+
+static inline void hm172_string_int_map_free_key(HM172Key key) {
+    free(key);
+}
+
+HM172_DEFINE_MAP_WITH_KEY_COPY(hm172_string_int_map, HM172Key, HM172Value, hm172_string_int_map_hash,
+                               hm172_string_int_map_equals, hm172_string_int_map_copy_key,
+                               hm172_string_int_map_free_key);
+
+#endif // HASHMAP_172_STRING_INT_MAP_H